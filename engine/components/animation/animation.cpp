@@ -0,0 +1,163 @@
+#include "animation.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "../style/style.h"
+#include "../stats/stats.h"
+
+namespace Animation {
+
+  struct Active {
+    Node* node;
+    const Style::Property* property;
+    TransitionSpec spec;
+    double startMs;
+    double lastMs;
+    float from[4];
+    float to[4];
+    float value[4];
+    float velocity[4];
+  };
+
+  static std::vector<Active> active;
+
+  static Active* find(Node* n, const Style::Property* p) {
+    for (Active& a : active) {
+      if (a.node == n && a.property == p) return &a;
+    }
+    return nullptr;
+  }
+
+  void start(Node* n, const Style::Property& p, const float* from, const float* to, const TransitionSpec& spec) {
+    double now = clockMs();
+    Active* a = find(n, &p);
+
+    if (a) {
+      if (std::equal(to, to + p.channels, a->to) && a->spec == spec) return;
+    } else {
+      active.push_back({});
+      a = &active.back();
+      a->node = n;
+      a->property = &p;
+      std::fill(a->velocity, a->velocity + 4, 0.0f);
+    }
+
+    // retargeting starts from wherever the property is now, springs keep their velocity
+    a->spec = spec;
+    a->startMs = now;
+    a->lastMs = now;
+    std::copy(from, from + p.channels, a->from);
+    std::copy(from, from + p.channels, a->value);
+    std::copy(to, to + p.channels, a->to);
+    n->isAnimating = true;
+  }
+
+  static void refreshAnimating(Node* n) {
+    n->isAnimating = false;
+    for (const Active& a : active) {
+      if (a.node == n) {
+        n->isAnimating = true;
+        return;
+      }
+    }
+  }
+
+  void cancel(Node* n, const Style::Property* p) {
+    if (!n->isAnimating) return;
+    active.erase(std::remove_if(active.begin(), active.end(), [&](const Active& a) {
+      return a.node == n && (!p || a.property == p);
+    }), active.end());
+    refreshAnimating(n);
+  }
+
+  static float ease(Easing e, float t) {
+    switch (e) {
+      case Easing::Linear: return t;
+      case Easing::EaseIn: return t * t;
+      case Easing::EaseOut: return 1.0f - (1.0f - t) * (1.0f - t);
+      default: return t < 0.5f ? 2.0f * t * t : 1.0f - 2.0f * (1.0f - t) * (1.0f - t);
+    }
+  }
+
+  // returns true when the animation reached its target
+  static bool advanceTween(Active& a, double now) {
+    float t = a.spec.durationMs > 0 ? (float)((now - a.startMs) / a.spec.durationMs) : 1.0f;
+    t = std::max(0.0f, t);
+    if (t >= 1.0f) {
+      std::copy(a.to, a.to + 4, a.value);
+      return true;
+    }
+
+    float e = ease(a.spec.easing, t);
+    for (int c = 0; c < a.property->channels; c++) {
+      a.value[c] = a.from[c] + (a.to[c] - a.from[c]) * e;
+    }
+    return false;
+  }
+
+  static bool advanceSpring(Active& a, double now) {
+    float dt = std::max(0.0f, (float)(now - a.lastMs) / 1000.0f);
+    bool settled = true;
+
+    // fixed substeps keep stiff springs stable on long frames
+    const float maxStep = 1.0f / 240.0f;
+    int steps = std::max(1, (int)std::ceil(dt / maxStep));
+    float h = dt / steps;
+
+    for (int c = 0; c < a.property->channels; c++) {
+      float x = a.value[c];
+      float v = a.velocity[c];
+      for (int i = 0; i < steps; i++) {
+        float force = -a.spec.stiffness * (x - a.to[c]) - a.spec.damping * v;
+        v += force * h;
+        x += v * h;
+      }
+      a.value[c] = x;
+      a.velocity[c] = v;
+
+      float range = std::max(1.0f, std::fabs(a.to[c] - a.from[c]));
+      if (std::fabs(x - a.to[c]) > range * 0.001f || std::fabs(v) > range * 0.01f) {
+        settled = false;
+      }
+    }
+
+    if (settled) {
+      std::copy(a.to, a.to + 4, a.value);
+    }
+    return settled;
+  }
+
+  bool tick(double now) {
+    if (active.empty()) return false;
+
+    std::vector<Node*> finished;
+
+    for (size_t i = 0; i < active.size();) {
+      Active& a = active[i];
+      bool done = a.spec.spring ? advanceSpring(a, now) : advanceTween(a, now);
+      a.lastMs = now;
+
+      a.property->set(a.node, a.value);
+      Style::invalidate(a.node, a.property->invalidation);
+
+      if (done) {
+        finished.push_back(a.node);
+        active[i] = active.back();
+        active.pop_back();
+      } else {
+        i++;
+      }
+    }
+
+    for (Node* n : finished) {
+      refreshAnimating(n);
+    }
+
+    EngineStats::instance().animations = active.size();
+    return !active.empty();
+  }
+
+  size_t activeCount() {
+    return active.size();
+  }
+}
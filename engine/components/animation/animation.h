@@ -0,0 +1,21 @@
+#pragma once
+#include "../ui/ui.h"
+
+namespace Style {
+  struct Property;
+}
+
+namespace Animation {
+  // animates property p of n from `from` to `to`, retargeting a running
+  // animation of the same property. The node must already hold `from`
+  void start(Node* n, const Style::Property& p, const float* from, const float* to, const TransitionSpec& spec);
+
+  // stops animations of n, only property p if given. The property keeps its current value
+  void cancel(Node* n, const Style::Property* p = nullptr);
+
+  // advances every running animation to `nowMs` and dirties the animated
+  // nodes, paint only properties never reach layout. false when idle
+  bool tick(double nowMs);
+
+  size_t activeCount();
+}
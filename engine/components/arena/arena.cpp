@@ -0,0 +1,77 @@
+#include "arena.h"
+#include <algorithm>
+#include <vector>
+
+namespace Arena {
+
+  struct Block {
+    char* data;
+    size_t size;
+  };
+
+  static const size_t FIRST_BLOCK = 64 * 1024;
+
+  static std::vector<Block> blocks;
+  // block being bumped and the bytes used in it, blocks past it are free
+  static size_t current = 0;
+  static size_t used = 0;
+
+  static void grow(size_t bytes) {
+    size_t size = blocks.empty() ? FIRST_BLOCK : blocks.back().size * 2;
+    size = std::max(size, bytes);
+    blocks.push_back({new char[size], size});
+    current = blocks.size() - 1;
+    used = 0;
+  }
+
+  void* alloc(size_t bytes, size_t align) {
+    if (bytes == 0) bytes = 1;
+
+    while (true) {
+      if (current < blocks.size()) {
+        Block& b = blocks[current];
+        size_t at = (used + align - 1) & ~(align - 1);
+        if (at + bytes <= b.size) {
+          used = at + bytes;
+          return b.data + at;
+        }
+        // blocks kept from before a rewind are tried before growing
+        if (current + 1 < blocks.size()) {
+          current++;
+          used = 0;
+          continue;
+        }
+      }
+      grow(bytes + align);
+    }
+  }
+
+  Mark mark() {
+    return {current, used};
+  }
+
+  void rewind(const Mark& m) {
+    current = m.block;
+    used = m.used;
+  }
+
+  void reset() {
+    if (blocks.size() > 1) {
+      size_t total = 0;
+      for (Block& b : blocks) {
+        total += b.size;
+        delete[] b.data;
+      }
+      blocks.clear();
+      grow(total);
+    }
+    current = 0;
+    used = 0;
+  }
+
+  size_t capacity() {
+    size_t total = 0;
+    for (const Block& b : blocks) total += b.size;
+    return total;
+  }
+}
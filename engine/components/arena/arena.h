@@ -0,0 +1,44 @@
+#pragma once
+#include <cstddef>
+#include <type_traits>
+
+// bump allocator for temporaries of the current frame, reconcile and layout
+// scratch live here instead of on the heap. Nothing is destructed, so only
+// trivially destructible types go in, and strings are views into lua
+namespace Arena {
+  struct Mark {
+    size_t block;
+    size_t used;
+  };
+
+  void* alloc(size_t bytes, size_t align);
+
+  template <typename T>
+  T* array(size_t count) {
+    static_assert(std::is_trivially_destructible<T>::value, "arena memory is never destructed");
+    return static_cast<T*>(alloc(sizeof(T) * count, alignof(T)));
+  }
+
+  Mark mark();
+
+  // hands everything allocated since m back, used for scratch that is done
+  // before the frame is
+  void rewind(const Mark& m);
+
+  // start of a frame. If the last one needed more than the first block, the
+  // blocks are merged so the next frame fits without growing
+  void reset();
+
+  // bytes held, whether in use or not
+  size_t capacity();
+
+  // rewinds to where it was opened once it goes out of scope
+  struct Scope {
+    Mark start;
+
+    Scope() : start(mark()) {}
+    ~Scope() { rewind(start); }
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+  };
+}
@@ -0,0 +1,851 @@
+#include "bench.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <iostream>
+#include <new>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "../runtime/runtime.h"
+#include "../stats/stats.h"
+#include "../native/native.h"
+#include "../vdom/vdom.h"
+#include "../memory/memory.h"
+#include "../layout/layout.h"
+#include "../style/style.h"
+#include "../refs/refs.h"
+#include "../arena/arena.h"
+#include "../animation/animation.h"
+#include "../render/render.h"
+#include "../input/input.h"
+
+// every operator new in the process is counted, so the bench can show that
+// a frame over an unchanged tree does not touch the heap. Only built with
+// -DVULPIS_COUNT_ALLOCS=ON, a release binary keeps the default allocator
+static std::atomic<size_t> heapAllocations{0};
+
+#ifdef VULPIS_COUNT_ALLOCS
+
+void* operator new(std::size_t size) {
+  heapAllocations.fetch_add(1, std::memory_order_relaxed);
+  if (size == 0) size = 1;
+  if (void* p = std::malloc(size)) return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+  std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+  std::free(p);
+}
+#endif
+
+namespace Bench {
+
+  struct Result {
+    int nodes = 0;
+    double buildMs = 0;
+    double reconcileMs = 0;
+  };
+
+  static int countNodes(Node* root) {
+    int count = 0;
+    walkTree(root, [&count](Node*) {
+      count++;
+      return true;
+    });
+    return count;
+  }
+
+  // calls bench[builder](rows, tick), leaves the tree on the stack
+  static bool callBuilder(lua_State* L, int benchIdx, const char* builder, int rows, int tick) {
+    lua_getfield(L, benchIdx, builder);
+    lua_pushinteger(L, rows);
+    lua_pushinteger(L, tick);
+    if (lua_pcall(L, 2, 1, 0) != LUA_OK) {
+      std::cerr << "Bench Error: " << lua_tostring(L, -1) << std::endl;
+      lua_pop(L, 1);
+      return false;
+    }
+    return true;
+  }
+
+  static bool measure(lua_State* L, int benchIdx, const char* builder, int rows, int iterations, Result& out) {
+    double start = nowMs();
+    for (int i = 0; i < iterations; i++) {
+      if (!callBuilder(L, benchIdx, builder, rows, i)) return false;
+      Node* root = buildNode(L, -1);
+      lua_pop(L, 1);
+      Native::releasePending();
+
+      if (i == 0) out.nodes = countNodes(root);
+      freeTree(root);
+      Memory::flush(L);
+    }
+    out.buildMs = (nowMs() - start) / iterations;
+
+    if (!callBuilder(L, benchIdx, builder, rows, 0)) return false;
+    Node* root = buildNode(L, -1);
+    lua_pop(L, 1);
+
+    // every tick flips the row colors, so each reconcile patches the whole tree
+    start = nowMs();
+    for (int i = 1; i <= iterations; i++) {
+      if (!callBuilder(L, benchIdx, builder, rows, i)) {
+        freeTree(root);
+        return false;
+      }
+      VDOM::reconcile(L, root, lua_gettop(L));
+      lua_pop(L, 1);
+      Native::releasePending();
+      Memory::flush(L);
+    }
+    out.reconcileMs = (nowMs() - start) / iterations;
+
+    freeTree(root);
+    Memory::flush(L);
+    return true;
+  }
+
+  // random tree made only of features both solvers implement. Percent sizes
+  // only go under a parent whose size is known before layout, meaning the
+  // root or a fixed size that neither grows nor has limits. The default
+  // solver resolves them before flex and stretch run
+  static Node* randomTree(std::mt19937& rng, int depth, int breadth, bool definiteW = true, bool definiteH = true, bool root = true) {
+    auto pick = [&rng](int lo, int hi) {
+      return std::uniform_int_distribution<int>(lo, hi)(rng);
+    };
+    auto length = [&pick](bool definite, int lo, int hi) {
+      if (definite && pick(0, 3) == 0) return Length::Percent((float)pick(1, 5) * 10);
+      return Length(pick(lo, hi) * 8);
+    };
+
+    Node* n = new Node();
+    n->type = pick(0, 1) ? "hbox" : "vbox";
+    n->spacing = pick(0, 2) * 4;
+    n->paddingTop = pick(0, 2) * 4;
+    n->paddingBottom = pick(0, 2) * 4;
+    n->paddingLeft = pick(0, 2) * 4;
+    n->paddingRight = pick(0, 2) * 4;
+    n->alignItems = (Align)pick(0, 3);
+    n->justifyContent = (Justify)pick(0, 5);
+    if (root) {
+      definiteW = definiteH = true;
+    } else {
+      n->marginTop = pick(0, 1) * 2;
+      n->marginLeft = pick(0, 1) * 2;
+      n->marginBottom = pick(0, 1) * 3;
+      n->marginRight = pick(0, 1) * 3;
+      if (pick(0, 3) == 0) n->flexGrow = (float)pick(1, 2);
+      if (pick(0, 5) == 0) n->minWidth = (float)pick(2, 12) * 8;
+      if (pick(0, 5) == 0) n->maxWidth = (float)pick(2, 12) * 8;
+      if (pick(0, 5) == 0) n->minHeight = (float)pick(2, 12) * 8;
+      if (pick(0, 5) == 0) n->maxHeight = (float)pick(2, 12) * 8;
+      if (pick(0, 11) == 0) n->displayNone = true;
+    }
+
+    if (depth == 0) {
+      n->widthStyle = length(definiteW, 2, 8);
+      n->heightStyle = length(definiteH, 2, 6);
+      return n;
+    }
+
+    if (!root && pick(0, 3) == 0) n->widthStyle = length(definiteW, 10, 40);
+    if (!root && pick(0, 3) == 0) n->heightStyle = length(definiteH, 8, 30);
+    bool fixed = root || (n->flexGrow == 0 && n->minWidth == 0 && n->maxWidth >= 99999.0f &&
+      n->minHeight == 0 && n->maxHeight >= 99999.0f);
+    bool childW = fixed && (root || n->widthStyle.value != 0);
+    bool childH = fixed && (root || n->heightStyle.value != 0);
+
+    // now and then a long list or a wide row
+    int count = depth == 1 && pick(0, 5) == 0 ? pick(50, 200) : pick(1, breadth);
+    for (int i = 0; i < count; i++) {
+      Node* c = randomTree(rng, depth - 1, breadth, childW, childH, false);
+      c->parent = n;
+      n->children.push_back(c);
+    }
+    return n;
+  }
+
+  struct Rect {
+    float x, y, w, h;
+  };
+
+  // hidden subtrees have no layout worth comparing
+  static void collectRects(Node* root, std::vector<Rect>& out) {
+    walkTree(root, [&out](Node* n) {
+      if (n->displayNone) return false;
+      out.push_back({n->x, n->y, n->w, n->h});
+      return true;
+    });
+  }
+
+  // drops whatever a solver kept from the last solve, so every timed solve starts cold
+  static void coldLayout(Node* root) {
+    walkTree(root, [](Node* n) {
+      Layout::release(n);
+      n->isLayoutDirty = true;
+      return true;
+    });
+  }
+
+  static double timeSolver(Layout::LayoutSolver* solver, Node* root, Layout::Size viewport, int iterations) {
+    double start = nowMs();
+    for (int i = 0; i < iterations; i++) {
+      coldLayout(root);
+      solver->solve(root, viewport);
+    }
+    return (nowMs() - start) / iterations;
+  }
+
+  // `vulpis --bench --layout-parity [trees] [iterations]`, both solvers over
+  // generated trees, every rect has to agree to within a pixel
+  static int runLayoutParity(int argc, char* argv[]) {
+    int trees = argc > 3 ? std::atoi(argv[3]) : 50;
+    int iterations = argc > 4 ? std::atoi(argv[4]) : 20;
+    if (trees <= 0) trees = 50;
+    if (iterations <= 0) iterations = 20;
+
+    Layout::Size viewport = {1280, 800};
+    Layout::LayoutSolver* yoga = Layout::createYogaSolver();
+    Layout::LayoutSolver* simple = Layout::createDefaultSolver();
+
+    std::printf("%-6s %8s %12s %12s %10s\n", "tree", "nodes", "default(ms)", "yoga(ms)", "mismatch");
+
+    int failed = 0;
+    double defaultTotal = 0, yogaTotal = 0;
+    for (int t = 0; t < trees; t++) {
+      std::mt19937 rng(t + 1);
+      Node* root = randomTree(rng, 2 + t % 3, 2 + t % 5);
+
+      std::vector<Rect> expected, actual;
+      yoga->solve(root, viewport);
+      collectRects(root, expected);
+      simple->solve(root, viewport);
+      collectRects(root, actual);
+
+      int mismatches = 0;
+      for (size_t i = 0; i < expected.size(); i++) {
+        const Rect& a = expected[i];
+        const Rect& b = actual[i];
+        if (std::fabs(a.x - b.x) > 1 || std::fabs(a.y - b.y) > 1 ||
+            std::fabs(a.w - b.w) > 1 || std::fabs(a.h - b.h) > 1) {
+          if (mismatches == 0) {
+            std::fprintf(stderr, "tree %d node %zu: yoga %.1f,%.1f %.1fx%.1f default %.1f,%.1f %.1fx%.1f\n",
+              t, i, a.x, a.y, a.w, a.h, b.x, b.y, b.w, b.h);
+          }
+          mismatches++;
+        }
+      }
+      if (mismatches) failed++;
+
+      double defaultMs = timeSolver(simple, root, viewport, iterations);
+      double yogaMs = timeSolver(yoga, root, viewport, iterations);
+      defaultTotal += defaultMs;
+      yogaTotal += yogaMs;
+
+      std::printf("%-6d %8d %12.4f %12.4f %10d\n", t, countNodes(root), defaultMs, yogaMs, mismatches);
+      freeTree(root);
+    }
+
+    std::printf("total  %8s %12.4f %12.4f %10d\n", "", defaultTotal, yogaTotal, failed);
+    delete yoga;
+    delete simple;
+    return failed ? 1 : 0;
+  }
+
+  // element model the stress run mutates, pushed to lua as a fresh table every step
+  struct Spec {
+    int id = 0;
+    bool row = false;
+    std::string key;
+    int w = 0, h = 0;
+    int padding = 0;
+    int gap = 0;
+    int color = -1;
+    // index into the shared handler table, 0 for none
+    int click = 0;
+    std::vector<Spec> children;
+  };
+
+  static const int HANDLERS = 4;
+  static const char* COLORS[] = {"#ff0000", "#00ff00", "#0000ff", "#202020", "#ffffff"};
+
+  struct Stress {
+    std::mt19937 rng;
+    int nextId = 1;
+    int handlersIdx = 0;
+
+    int pick(int lo, int hi) {
+      return std::uniform_int_distribution<int>(lo, hi)(rng);
+    }
+
+    Spec leaf() {
+      Spec s;
+      s.id = nextId++;
+      s.row = pick(0, 1);
+      if (pick(0, 1)) s.key = "k" + std::to_string(s.id);
+      s.w = pick(0, 4) * 10;
+      s.h = pick(0, 4) * 10;
+      s.padding = pick(0, 2) * 2;
+      s.gap = pick(0, 2) * 2;
+      s.color = pick(-1, 4);
+      s.click = pick(0, HANDLERS);
+      return s;
+    }
+
+    Spec tree(int depth) {
+      Spec s = leaf();
+      if (depth > 0) {
+        int count = pick(0, 5);
+        for (int i = 0; i < count; i++) s.children.push_back(tree(depth - 1));
+      }
+      return s;
+    }
+
+    // every spec with its depth, parents before children
+    void collect(Spec& s, int depth, std::vector<std::pair<Spec*, int>>& out) {
+      out.push_back({&s, depth});
+      for (Spec& c : s.children) collect(c, depth + 1, out);
+    }
+
+    void mutate(Spec& root) {
+      std::vector<std::pair<Spec*, int>> all;
+      collect(root, 0, all);
+      auto [target, depth] = all[pick(0, (int)all.size() - 1)];
+      Spec& s = *target;
+
+      switch (pick(0, 7)) {
+        case 0:
+          if (all.size() < 400 && depth < 6) {
+            int at = pick(0, (int)s.children.size());
+            s.children.insert(s.children.begin() + at, tree(pick(0, 2)));
+          }
+          break;
+        case 1:
+          if (!s.children.empty()) s.children.erase(s.children.begin() + pick(0, (int)s.children.size() - 1));
+          break;
+        case 2:
+          std::shuffle(s.children.begin(), s.children.end(), rng);
+          break;
+        case 3:
+          if (s.children.size() > 1) {
+            int a = pick(0, (int)s.children.size() - 1);
+            int b = pick(0, (int)s.children.size() - 1);
+            std::swap(s.children[a], s.children[b]);
+          }
+          break;
+        case 4:
+          // new keys stay unique among siblings
+          s.key = pick(0, 2) ? "k" + std::to_string(nextId++) : "";
+          break;
+        case 5:
+          s.w = pick(0, 4) * 10;
+          s.padding = pick(0, 2) * 2;
+          s.color = pick(-1, 4);
+          break;
+        case 6:
+          s.row = !s.row;
+          break;
+        case 7:
+          s.click = pick(0, HANDLERS);
+          break;
+      }
+    }
+
+    void push(lua_State* L, const Spec& s) {
+      luaL_checkstack(L, 4, "element tree too deep");
+      lua_newtable(L);
+      lua_pushstring(L, s.row ? "hbox" : "vbox");
+      lua_setfield(L, -2, "type");
+      if (!s.key.empty()) {
+        lua_pushstring(L, s.key.c_str());
+        lua_setfield(L, -2, "key");
+      }
+      if (s.click) {
+        lua_rawgeti(L, handlersIdx, s.click);
+        lua_setfield(L, -2, "onClick");
+      }
+
+      lua_newtable(L);
+      if (s.w) { lua_pushinteger(L, s.w); lua_setfield(L, -2, "w"); }
+      if (s.h) { lua_pushinteger(L, s.h); lua_setfield(L, -2, "h"); }
+      if (s.padding) { lua_pushinteger(L, s.padding); lua_setfield(L, -2, "padding"); }
+      if (s.gap) { lua_pushinteger(L, s.gap); lua_setfield(L, -2, "gap"); }
+      if (s.color >= 0) { lua_pushstring(L, COLORS[s.color]); lua_setfield(L, -2, "BGColor"); }
+      lua_setfield(L, -2, "style");
+
+      lua_createtable(L, (int)s.children.size(), 0);
+      for (size_t i = 0; i < s.children.size(); i++) {
+        push(L, s.children[i]);
+        lua_rawseti(L, -2, (int)i + 1);
+      }
+      lua_setfield(L, -2, "children");
+    }
+  };
+
+  struct Place {
+    int parent;
+    int index;
+    std::string key;
+    bool row;
+  };
+
+  static void places(const Spec& s, int parent, int index, std::unordered_map<int, Place>& out) {
+    out[s.id] = {parent, index, s.key, s.row};
+    for (size_t i = 0; i < s.children.size(); i++) places(s.children[i], s.id, (int)i, out);
+  }
+
+  // nodes reconcile has to carry over: same parent, and either the same key or
+  // unkeyed at the same index, under a parent that was carried over itself
+  static int expectedReuse(const Spec& s, const std::unordered_map<int, Place>& before) {
+    int count = 1;
+    for (size_t i = 0; i < s.children.size(); i++) {
+      const Spec& c = s.children[i];
+      auto it = before.find(c.id);
+      if (it == before.end() || it->second.parent != s.id) continue;
+      const Place& p = it->second;
+      bool keyed = !c.key.empty() && p.key == c.key;
+      bool indexed = c.key.empty() && p.key.empty() && p.index == (int)i;
+      if (keyed || indexed) count += expectedReuse(c, before);
+    }
+    return count;
+  }
+
+  static bool sameRef(lua_State* L, int a, int b) {
+    if (a == -2 || b == -2) return a == b;
+    lua_rawgeti(L, LUA_REGISTRYINDEX, a);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, b);
+    bool same = lua_rawequal(L, -1, -2);
+    lua_pop(L, 2);
+    return same;
+  }
+
+  // reconciled node against one freshly built from the same element
+  static bool sameTree(lua_State* L, Node* live, Node* fresh, std::string& path) {
+    if (live->type != fresh->type) { path += " type"; return false; }
+    if (live->key != fresh->key) { path += " key"; return false; }
+    if (!sameRef(L, live->onClickRef, fresh->onClickRef)) { path += " onClick"; return false; }
+
+    // every style property through the shared table, a color left behind by a
+    // removed background is not drawn and does not count
+    Node scratch;
+    Style::copy(&scratch, live);
+    if (!live->hasBackground && !fresh->hasBackground) scratch.color = fresh->color;
+    if (Style::copy(&scratch, fresh) != Style::Invalidation::None) { path += " style"; return false; }
+
+    if (live->children.size() != fresh->children.size()) { path += " children"; return false; }
+    for (size_t i = 0; i < live->children.size(); i++) {
+      if (live->children[i]->parent != live) { path += " parent"; return false; }
+      path += "/" + std::to_string(i);
+      if (!sameTree(L, live->children[i], fresh->children[i], path)) return false;
+      path.resize(path.rfind('/'));
+    }
+    return true;
+  }
+
+  static size_t countHandlers(const Spec& s) {
+    size_t count = s.click ? 1 : 0;
+    for (const Spec& c : s.children) count += countHandlers(c);
+    return count;
+  }
+
+  // keys are unique across the stress tree, so every keyed node has to be
+  // what the index finds for its key and nothing else may be in there
+  static bool indexMatches(Node* root) {
+    size_t keyed = 0;
+    bool found = true;
+    walkTree(root, [&](Node* n) {
+      if (!n->key.empty()) {
+        keyed++;
+        if (Refs::find(n->key) != n) found = false;
+      }
+      return true;
+    });
+    return found && keyed == Refs::size();
+  }
+
+  // `vulpis --bench --reconcile-stress [steps] [seed]`, random element edits
+  // reconciled step by step, every result has to match a fresh build
+  static int runReconcileStress(int argc, char* argv[]) {
+    int steps = argc > 3 ? std::atoi(argv[3]) : 2000;
+    unsigned seed = argc > 4 ? (unsigned)std::atoi(argv[4]) : 1;
+    if (steps <= 0) steps = 2000;
+
+    lua_State* L = Runtime::newState();
+
+    // handlers are shared so an unchanged onClick keeps its ref
+    luaL_dostring(L, "local t = {} for i = 1, 4 do t[i] = function() end end return t");
+    Stress stress;
+    stress.rng.seed(seed);
+    stress.handlersIdx = lua_gettop(L);
+
+    Spec model = stress.tree(3);
+    model.key.clear();
+    stress.push(L, model);
+    Node* root = buildNode(L, -1);
+    lua_pop(L, 1);
+
+    std::printf("%-6s %8s %10s %8s %8s %8s %6s\n", "step", "nodes", "allocated", "reused", "freed", "expected", "refs");
+
+    unsigned long long allocated = 0, reused = 0, freed = 0, nodes = 0;
+    int mismatches = 0, shortfalls = 0, leaks = 0, stale = 0;
+    double reconcileMs = 0;
+
+    for (int step = 1; step <= steps; step++) {
+      std::unordered_map<int, Place> before;
+      places(model, 0, 0, before);
+
+      int edits = stress.pick(1, 4);
+      for (int i = 0; i < edits; i++) stress.mutate(model);
+      // reconcile matches the root whatever its key, so it has none
+      model.key.clear();
+
+      stress.push(L, model);
+      int elementIdx = lua_gettop(L);
+
+      size_t createdBefore = Node::createdCount;
+      size_t liveBefore = Node::liveCount;
+      double start = nowMs();
+      VDOM::reconcile(L, root, elementIdx);
+      reconcileMs += nowMs() - start;
+      Memory::flush(L);
+
+      size_t built = Node::createdCount - createdBefore;
+      size_t gone = built + liveBefore - Node::liveCount;
+      size_t count = (size_t)countNodes(root);
+      size_t kept = count - built;
+      int expected = expectedReuse(model, before);
+      size_t refs = Memory::refCount();
+
+      allocated += built;
+      reused += kept;
+      freed += gone;
+      nodes += count;
+
+      if ((int)kept < expected) {
+        if (!shortfalls) std::fprintf(stderr, "step %d: reused %zu nodes, expected at least %d\n", step, kept, expected);
+        shortfalls++;
+      }
+      if (refs != countHandlers(model)) {
+        if (!leaks) std::fprintf(stderr, "step %d: %zu refs held for %zu handlers\n", step, refs, countHandlers(model));
+        leaks++;
+      }
+      if (!indexMatches(root)) {
+        if (!stale) std::fprintf(stderr, "step %d: key index is out of step with the tree\n", step);
+        stale++;
+      }
+
+      Node* fresh = buildNode(L, elementIdx);
+      std::string path = "root";
+      if (!sameTree(L, root, fresh, path)) {
+        if (!mismatches) std::fprintf(stderr, "step %d: reconciled tree differs from a fresh build at %s\n", step, path.c_str());
+        mismatches++;
+      }
+      freeTree(fresh);
+      Memory::flush(L);
+      lua_pop(L, 1);
+
+      if (step % (steps / 10 > 0 ? steps / 10 : 1) == 0) {
+        std::printf("%-6d %8zu %10zu %8zu %8zu %8d %6zu\n", step, count, built, kept, gone, expected, refs);
+      }
+    }
+
+    std::printf("total: %llu nodes, %llu allocated, %llu reused (%.1f%%), %llu freed, %.4f ms per reconcile\n",
+      nodes, allocated, reused, nodes ? 100.0 * reused / nodes : 0.0, freed, reconcileMs / steps);
+    std::printf("mismatches %d, reuse shortfalls %d, ref leaks %d, key index errors %d\n", mismatches, shortfalls, leaks,
+      stale);
+
+    freeTree(root);
+    Memory::flush(L);
+    lua_close(L);
+    return mismatches || shortfalls || leaks || stale ? 1 : 0;
+  }
+
+  // the trees of utils/bench/bench.lua, left on the stack
+  static bool loadBench(lua_State* L) {
+    if (luaL_dostring(L, "return (require('bench.bench'))") != LUA_OK) {
+      std::cerr << "Bench Error: " << lua_tostring(L, -1) << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  // `vulpis --bench --steady-allocs [rows] [iterations]`, reconciles and lays
+  // out the table tree against identical ones and fails on any heap allocation
+  static int runSteadyAllocs(int argc, char* argv[]) {
+#ifndef VULPIS_COUNT_ALLOCS
+    std::cerr << "Bench Error: --steady-allocs needs a build with -DVULPIS_COUNT_ALLOCS=ON" << std::endl;
+    return 1;
+#endif
+    int rows = argc > 3 ? std::atoi(argv[3]) : 1000;
+    int iterations = argc > 4 ? std::atoi(argv[4]) : 50;
+    if (rows <= 0) rows = 1000;
+    if (iterations <= 0) iterations = 50;
+
+    lua_State* L = Runtime::newState();
+    if (!loadBench(L)) {
+      lua_close(L);
+      return 1;
+    }
+    int benchIdx = lua_gettop(L);
+
+    if (!callBuilder(L, benchIdx, "tableTree", rows, 0)) {
+      lua_close(L);
+      return 1;
+    }
+    Node* root = buildNode(L, -1);
+    lua_pop(L, 1);
+
+    Layout::LayoutSolver* solver = Layout::createDefaultSolver();
+    Layout::Size viewport = {1280, 720};
+
+    // the first passes fill the style cache, the arena and the scratch vectors
+    const int WARMUP = 3;
+    size_t reconcileAllocs = 0, solveAllocs = 0;
+    size_t worst = 0;
+
+    for (int i = 0; i < WARMUP + iterations; i++) {
+      if (!callBuilder(L, benchIdx, "tableTree", rows, 0)) break;
+      int elementIdx = lua_gettop(L);
+
+      size_t before = heapAllocations.load();
+      Arena::reset();
+      VDOM::reconcile(L, root, elementIdx);
+      Memory::flush(L);
+      size_t reconciled = heapAllocations.load();
+
+      root->makeLayoutDirty();
+      solver->solve(root, viewport);
+      size_t solved = heapAllocations.load();
+      lua_pop(L, 1);
+
+      if (i < WARMUP) continue;
+      reconcileAllocs += reconciled - before;
+      solveAllocs += solved - reconciled;
+      worst = std::max(worst, solved - before);
+    }
+
+    std::printf("%d nodes, %d frames: %zu allocations in reconcile, %zu in layout, at most %zu in a frame, arena %zu bytes\n",
+      countNodes(root), iterations, reconcileAllocs, solveAllocs, worst, Arena::capacity());
+
+    delete solver;
+    freeTree(root);
+    Memory::flush(L);
+    lua_close(L);
+    return reconcileAllocs || solveAllocs ? 1 : 0;
+  }
+
+  // reconciles the element returned by `code` into root at clock time `at`
+  static void reconcileAt(lua_State* L, Node* root, const char* code, double at) {
+    pinnedClockMs() = at;
+    luaL_dostring(L, code);
+    VDOM::reconcile(L, root, lua_gettop(L));
+    lua_pop(L, 1);
+  }
+
+  // `vulpis --bench --transition-switch`, values that can not be interpolated
+  // (a percent w, a removed BGColor) set mid-transition have to stick
+  static int runTransitionSwitch() {
+    lua_State* L = Runtime::newState();
+    int failed = 0;
+
+    const char* start = "return { type = 'vbox', style = { w = 100, BGColor = '#000000', "
+      "transition = { w = 200, BGColor = 200 } } }";
+    luaL_dostring(L, start);
+    pinnedClockMs() = 0;
+    Node* n = buildNode(L, -1);
+    lua_pop(L, 1);
+
+    reconcileAt(L, n, "return { type = 'vbox', style = { w = 300, BGColor = '#ffffff', "
+      "transition = { w = 200, BGColor = 200 } } }", 0);
+    Animation::tick(100);
+    reconcileAt(L, n, "return { type = 'vbox', style = { w = '50%', transition = { w = 200, BGColor = 200 } } }", 100);
+    Animation::tick(150);
+    Animation::tick(400);
+
+    if (n->widthStyle.type != PERCENT || n->widthStyle.value != 50) {
+      std::fprintf(stderr, "w is %g%s after switching to 50%%\n", n->widthStyle.value,
+        n->widthStyle.type == PERCENT ? "%" : "px");
+      failed++;
+    }
+    if (n->hasBackground) {
+      std::fprintf(stderr, "removed BGColor came back\n");
+      failed++;
+    }
+    if (n->isAnimating || Animation::activeCount() != 0) {
+      std::fprintf(stderr, "%zu animations still running\n", Animation::activeCount());
+      failed++;
+    }
+
+    std::printf("transition switch: %s\n", failed ? "failed" : "ok");
+    pinnedClockMs() = -1;
+    freeTree(n);
+    Memory::flush(L);
+    lua_close(L);
+    return failed ? 1 : 0;
+  }
+
+  // draws nothing, only counts what renderNode asks for
+  class CountingBackend : public Render::RenderBackend {
+    public:
+      size_t fills = 0;
+
+      void begin(int w, int h, SDL_Color) override { current = {0, 0, w, h}; fills = 0; }
+      void present() override {}
+      SDL_Rect clip() override { return current; }
+      void setClip(const SDL_Rect& rect) override { current = rect; }
+      void fillRect(const SDL_Rect&, SDL_Color) override { fills++; }
+      void fillGeometry(const SDL_Vertex*, int, const int*, int) override { fills++; }
+      bool readPixels(std::vector<uint32_t>&, int&, int&) override { return false; }
+
+    private:
+      SDL_Rect current = {0, 0, 0, 0};
+  };
+
+  static Node* boxNode(Node* parent, float x, float y, float w, float h) {
+    Node* n = new Node();
+    n->type = "box";
+    n->x = x;
+    n->y = y;
+    n->w = w;
+    n->h = h;
+    n->hasBackground = true;
+    n->color = {32, 32, 32, 255};
+    if (parent) {
+      n->parent = parent;
+      parent->children.push_back(n);
+    }
+    return n;
+  }
+
+  // nodes nested in one chain, every one covering the window
+  static Node* deepTree(int nodes, Node*& leaf) {
+    Node* root = boxNode(nullptr, 0, 0, 1280, 800);
+    leaf = root;
+    for (int i = 1; i < nodes; i++) {
+      leaf = boxNode(leaf, 0, 0, 1280, 800);
+    }
+    return root;
+  }
+
+  // one parent over a grid of 8x8 cells, the hit point is on the first cell
+  // so hitTest has to scan every sibling from the back
+  static Node* wideTree(int nodes, Node*& first) {
+    Node* root = boxNode(nullptr, 0, 0, 1280, 800);
+    for (int i = 1; i < nodes; i++) {
+      boxNode(root, (float)((i - 1) % 160 * 8), (float)((i - 1) / 160 * 8), 8, 8);
+    }
+    first = root->children.empty() ? root : root->children.front();
+    return root;
+  }
+
+  // `vulpis --bench --tree-walk [nodes] [iterations]`, renderNode and hitTest
+  // over a deep chain and a wide tree of the same size
+  static int runTreeWalk(int argc, char* argv[]) {
+    int nodes = argc > 3 ? std::atoi(argv[3]) : 10000;
+    int iterations = argc > 4 ? std::atoi(argv[4]) : 200;
+    if (nodes <= 0) nodes = 10000;
+    if (iterations <= 0) iterations = 200;
+
+    std::printf("%-6s %8s %10s %10s\n", "tree", "nodes", "draw(ms)", "hit(us)");
+
+    CountingBackend backend;
+    int failed = 0;
+    const char* names[] = {"deep", "wide"};
+
+    for (int t = 0; t < 2; t++) {
+      Node* expected = nullptr;
+      Node* root = t == 0 ? deepTree(nodes, expected) : wideTree(nodes, expected);
+
+      double start = nowMs();
+      for (int i = 0; i < iterations; i++) {
+        backend.begin(1280, 800, {0, 0, 0, 255});
+        renderNode(backend, root);
+      }
+      double drawMs = (nowMs() - start) / iterations;
+
+      Node* hit = nullptr;
+      start = nowMs();
+      for (int i = 0; i < iterations; i++) {
+        hit = Input::hitTest(root, 1, 1);
+      }
+      double hitUs = (nowMs() - start) * 1000 / iterations;
+
+      if (backend.fills != (size_t)nodes || hit != expected) {
+        std::fprintf(stderr, "%s: %zu of %d nodes drawn, hit %s\n",
+          names[t], backend.fills, nodes, hit == expected ? "ok" : "wrong node");
+        failed++;
+      }
+
+      std::printf("%-6s %8d %10.4f %10.3f\n", names[t], nodes, drawMs, hitUs);
+      freeTree(root);
+    }
+
+    return failed ? 1 : 0;
+  }
+
+  int run(int argc, char* argv[]) {
+    if (argc > 2 && std::string(argv[2]) == "--layout-parity") {
+      return runLayoutParity(argc, argv);
+    }
+    if (argc > 2 && std::string(argv[2]) == "--reconcile-stress") {
+      return runReconcileStress(argc, argv);
+    }
+    if (argc > 2 && std::string(argv[2]) == "--transition-switch") {
+      return runTransitionSwitch();
+    }
+    if (argc > 2 && std::string(argv[2]) == "--steady-allocs") {
+      return runSteadyAllocs(argc, argv);
+    }
+    if (argc > 2 && std::string(argv[2]) == "--tree-walk") {
+      return runTreeWalk(argc, argv);
+    }
+
+    int rows = argc > 2 ? std::atoi(argv[2]) : 1000;
+    int iterations = argc > 3 ? std::atoi(argv[3]) : 50;
+    if (rows <= 0) rows = 1000;
+    if (iterations <= 0) iterations = 50;
+
+    lua_State* L = Runtime::newState();
+
+    if (!loadBench(L)) {
+      lua_close(L);
+      return 1;
+    }
+    int benchIdx = lua_gettop(L);
+
+    lua_getfield(L, benchIdx, "hasNative");
+    bool hasNative = lua_toboolean(L, -1);
+    lua_pop(L, 1);
+
+    std::printf("backend: %s\n", Runtime::backendName());
+    std::printf("%-8s %8s %12s %16s\n", "path", "nodes", "build(ms)", "reconcile(ms)");
+
+    const char* paths[] = {"table", "native"};
+    const char* builders[] = {"tableTree", "nativeTree"};
+
+    for (int p = 0; p < 2; p++) {
+      if (p == 1 && !hasNative) {
+        std::printf("%-8s %8s\n", paths[p], "n/a");
+        continue;
+      }
+
+      Result r;
+      if (!measure(L, benchIdx, builders[p], rows, iterations, r)) {
+        lua_close(L);
+        return 1;
+      }
+      std::printf("%-8s %8d %12.3f %16.3f\n", paths[p], r.nodes, r.buildMs, r.reconcileMs);
+    }
+
+    lua_close(L);
+    return 0;
+  }
+}
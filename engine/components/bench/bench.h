@@ -0,0 +1,8 @@
+#pragma once
+
+namespace Bench {
+  // headless benchmark mode, `vulpis --bench [rows] [iterations]`, or
+  // `vulpis --bench --layout-parity [trees] [iterations]` to compare the solvers,
+  // or `vulpis --bench --reconcile-stress [steps] [seed]` to check reconcile
+  int run(int argc, char* argv[]);
+}
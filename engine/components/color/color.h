@@ -6,3 +6,7 @@
 
 SDL_Color parseHexColor(const char* hexStr);
 
+// "#rrggbb", "#rrggbbaa" or a css color name like "tomato" or "transparent",
+// names in any case. Opaque black for anything else
+SDL_Color parseColor(const char* str);
+
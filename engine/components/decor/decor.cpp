@@ -0,0 +1,158 @@
+#include "decor.h"
+#include <algorithm>
+#include <cmath>
+#include "../render/render.h"
+#include "../stats/stats.h"
+
+namespace Decor {
+
+  static const float PI = 3.14159265f;
+
+  static bool operator==(const SDL_Color& a, const SDL_Color& b) {
+    return a.r == b.r && a.g == b.g && a.b == b.b && a.a == b.a;
+  }
+
+  bool needed(const Node* n) {
+    return n->borderRadius > 0 || n->borderWidth > 0 || n->shadow.enabled;
+  }
+
+  static bool matches(const Mesh& m, const Node* n) {
+    return m.w == n->w && m.h == n->h && m.radius == n->borderRadius &&
+      m.borderWidth == n->borderWidth && m.fill == n->color && m.border == n->borderColor &&
+      m.hasFill == n->hasBackground && m.shadow == n->shadow;
+  }
+
+  // arcs get finer with the radius, a square corner is a single point
+  static int segmentsFor(float radius) {
+    if (radius <= 0) return 0;
+    return std::min(16, std::max(2, (int)(radius / 2)));
+  }
+
+  // clockwise outline of a rounded rect starting at the top left corner,
+  // (segments + 1) points per corner
+  static void outline(float x0, float y0, float x1, float y1, float radius, int segments, std::vector<SDL_FPoint>& out) {
+    radius = std::max(0.0f, std::min(radius, std::min(x1 - x0, y1 - y0) / 2));
+    const float cx[4] = {x0 + radius, x1 - radius, x1 - radius, x0 + radius};
+    const float cy[4] = {y0 + radius, y0 + radius, y1 - radius, y1 - radius};
+
+    out.clear();
+    for (int corner = 0; corner < 4; corner++) {
+      float start = PI + corner * PI / 2;
+      for (int s = 0; s <= segments; s++) {
+        float angle = start + (segments ? (PI / 2) * s / segments : 0);
+        out.push_back({cx[corner] + radius * std::cos(angle), cy[corner] + radius * std::sin(angle)});
+      }
+    }
+  }
+
+  static void addVertex(Mesh& m, SDL_FPoint p, SDL_Color c) {
+    m.vertices.push_back({p, c, {0, 0}});
+  }
+
+  // triangle fan from the middle of a convex outline
+  static void fan(Mesh& m, const std::vector<SDL_FPoint>& points, SDL_FPoint center, SDL_Color c) {
+    int base = (int)m.vertices.size();
+    addVertex(m, center, c);
+    for (const SDL_FPoint& p : points) addVertex(m, p, c);
+
+    int count = (int)points.size();
+    for (int i = 0; i < count; i++) {
+      m.indices.push_back(base);
+      m.indices.push_back(base + 1 + i);
+      m.indices.push_back(base + 1 + (i + 1) % count);
+    }
+  }
+
+  // quads between two outlines with the same point count
+  static void ring(Mesh& m, const std::vector<SDL_FPoint>& outer, SDL_Color outerColor,
+                   const std::vector<SDL_FPoint>& inner, SDL_Color innerColor) {
+    int base = (int)m.vertices.size();
+    int count = (int)outer.size();
+    for (int i = 0; i < count; i++) {
+      addVertex(m, outer[i], outerColor);
+      addVertex(m, inner[i], innerColor);
+    }
+
+    for (int i = 0; i < count; i++) {
+      int o0 = base + i * 2, i0 = o0 + 1;
+      int o1 = base + ((i + 1) % count) * 2, i1 = o1 + 1;
+      m.indices.insert(m.indices.end(), {o0, o1, i0, i0, o1, i1});
+    }
+  }
+
+  static void build(Mesh& m, const Node* n) {
+    m.vertices.clear();
+    m.indices.clear();
+
+    float w = n->w, h = n->h;
+    float radius = n->borderRadius;
+    int segments = segmentsFor(radius);
+    std::vector<SDL_FPoint> outer, inner;
+
+    // shadow: a solid core that fades out across the blur
+    const BoxShadow& s = n->shadow;
+    if (s.enabled && s.color.a > 0) {
+      float half = s.blur / 2;
+      float x0 = s.x - s.spread, y0 = s.y - s.spread;
+      float x1 = w + s.x + s.spread, y1 = h + s.y + s.spread;
+      int shadowSegments = segmentsFor(radius + half);
+
+      outline(x0 + half, y0 + half, x1 - half, y1 - half, std::max(0.0f, radius - half), shadowSegments, inner);
+      fan(m, inner, {(x0 + x1) / 2, (y0 + y1) / 2}, s.color);
+
+      if (half > 0) {
+        SDL_Color clear = s.color;
+        clear.a = 0;
+        outline(x0 - half, y0 - half, x1 + half, y1 + half, radius + half, shadowSegments, outer);
+        ring(m, outer, clear, inner, s.color);
+      }
+    }
+
+    outline(0, 0, w, h, radius, segments, outer);
+    if (n->hasBackground) {
+      fan(m, outer, {w / 2, h / 2}, n->color);
+    }
+
+    if (n->borderWidth > 0) {
+      float bw = (float)std::min(n->borderWidth, (int)(std::min(w, h) / 2));
+      outline(bw, bw, w - bw, h - bw, std::max(0.0f, radius - bw), segments, inner);
+      ring(m, outer, n->borderColor, inner, n->borderColor);
+    }
+
+    m.w = w;
+    m.h = h;
+    m.radius = radius;
+    m.borderWidth = n->borderWidth;
+    m.fill = n->color;
+    m.border = n->borderColor;
+    m.hasFill = n->hasBackground;
+    m.shadow = n->shadow;
+    EngineStats::instance().meshBuilds++;
+  }
+
+  void draw(Render::RenderBackend& b, Node* n, float x, float y) {
+    if (!n->mesh) n->mesh = new Mesh();
+    Mesh& m = *n->mesh;
+    if (!matches(m, n)) build(m, n);
+    if (m.indices.empty()) return;
+
+    static std::vector<SDL_Vertex> placed;
+    placed.assign(m.vertices.begin(), m.vertices.end());
+    for (SDL_Vertex& v : placed) {
+      v.position.x += x;
+      v.position.y += y;
+    }
+    b.fillGeometry(placed.data(), (int)placed.size(), m.indices.data(), (int)m.indices.size());
+  }
+
+  void release(Node* n) {
+    delete n->mesh;
+    n->mesh = nullptr;
+  }
+
+  size_t bytes(const Node* n) {
+    if (!n->mesh) return 0;
+    return sizeof(Mesh) + n->mesh->vertices.capacity() * sizeof(SDL_Vertex) +
+      n->mesh->indices.capacity() * sizeof(int);
+  }
+}
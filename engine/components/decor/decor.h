@@ -0,0 +1,38 @@
+#pragma once
+#include <SDL2/SDL.h>
+#include <vector>
+#include "../ui/ui.h"
+
+namespace Render { class RenderBackend; }
+
+// rounded corners, borders and box shadows. The triangles are built relative
+// to the node's origin and cached on the node until its size or one of these
+// styles changes, drawing only offsets them
+namespace Decor {
+
+  struct Mesh {
+    // what the geometry was built for
+    float w = -1, h = -1;
+    float radius = 0;
+    int borderWidth = 0;
+    SDL_Color fill = {0, 0, 0, 0};
+    SDL_Color border = {0, 0, 0, 0};
+    bool hasFill = false;
+    BoxShadow shadow;
+
+    std::vector<SDL_Vertex> vertices;
+    std::vector<int> indices;
+  };
+
+  // false when a plain rect fill is all n needs
+  bool needed(const Node* n);
+
+  // draws n's shadow, background and border with its origin at x, y
+  void draw(Render::RenderBackend& b, Node* n, float x, float y);
+
+  // frees the cached mesh of n
+  void release(Node* n);
+
+  // bytes held by n's mesh
+  size_t bytes(const Node* n);
+}
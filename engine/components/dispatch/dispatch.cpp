@@ -0,0 +1,81 @@
+#include "dispatch.h"
+#include <iostream>
+
+namespace Dispatch {
+
+  // a batch is { {fn, n, args...}, ... }, errors come back as a list of strings
+  static const char* TRAMPOLINE =
+    "local pcall, unpack = pcall, table.unpack or unpack\n"
+    "return function(batch)\n"
+    "  local errors\n"
+    "  for i = 1, #batch do\n"
+    "    local call = batch[i]\n"
+    "    local ok, err = pcall(call[1], unpack(call, 3, call[2] + 2))\n"
+    "    if not ok then\n"
+    "      errors = errors or {}\n"
+    "      errors[#errors + 1] = tostring(err)\n"
+    "    end\n"
+    "  end\n"
+    "  return errors\n"
+    "end\n";
+
+  static const char* TRAMPOLINE_KEY = "vulpis.dispatch";
+
+  static void pushTrampoline(lua_State* L) {
+    lua_getfield(L, LUA_REGISTRYINDEX, TRAMPOLINE_KEY);
+    if (lua_isfunction(L, -1)) return;
+    lua_pop(L, 1);
+
+    luaL_loadstring(L, TRAMPOLINE);
+    lua_call(L, 0, 1);
+    lua_pushvalue(L, -1);
+    lua_setfield(L, LUA_REGISTRYINDEX, TRAMPOLINE_KEY);
+  }
+
+  Batch::Batch(lua_State* L, const char* label) : L(L), label(label) {
+    pushTrampoline(L);
+    lua_newtable(L);
+  }
+
+  void Batch::add(int ref, int nargs) {
+    int first = lua_gettop(L) - nargs + 1;
+
+    lua_createtable(L, nargs + 2, 0);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, ref);
+    lua_rawseti(L, -2, 1);
+    lua_pushinteger(L, nargs);
+    lua_rawseti(L, -2, 2);
+    for (int i = 0; i < nargs; i++) {
+      lua_pushvalue(L, first + i);
+      lua_rawseti(L, -2, i + 3);
+    }
+
+    // batch table sits right below the arguments
+    lua_rawseti(L, first - 1, ++count);
+    lua_pop(L, nargs);
+  }
+
+  int Batch::run() {
+    if (count == 0) {
+      lua_pop(L, 2);
+      return 0;
+    }
+
+    if (lua_pcall(L, 1, 1, 0) != LUA_OK) {
+      std::cout << label << lua_tostring(L, -1) << std::endl;
+      lua_pop(L, 1);
+      return count;
+    }
+
+    if (lua_istable(L, -1)) {
+      int errors = (int)lua_rawlen(L, -1);
+      for (int i = 1; i <= errors; i++) {
+        lua_rawgeti(L, -1, i);
+        std::cout << label << lua_tostring(L, -1) << std::endl;
+        lua_pop(L, 1);
+      }
+    }
+    lua_pop(L, 1);
+    return count;
+  }
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include "../../lua.hpp"
+
+namespace Dispatch {
+  // collects lua handler calls and runs them through a single lua_pcall.
+  // A failing handler is reported under `label` and does not stop the rest
+  class Batch {
+    public:
+      Batch(lua_State* L, const char* label);
+
+      // queues a call to the registry ref `ref` with the `nargs` values on
+      // top of the stack as arguments, the values are popped
+      void add(int ref, int nargs);
+
+      // runs the queued calls, returns how many there were
+      int run();
+
+    private:
+      lua_State* L;
+      const char* label;
+      int count = 0;
+  };
+}
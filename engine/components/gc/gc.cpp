@@ -0,0 +1,109 @@
+#include "gc.h"
+#include <algorithm>
+#include <cstring>
+#include "../stats/stats.h"
+
+namespace GC {
+
+  static Config config;
+  static size_t heapAfterCycle = 0;
+  static bool cycleRunning = false;
+
+  size_t heapBytes(lua_State* L) {
+    return (size_t)lua_gc(L, LUA_GCCOUNT, 0) * 1024 + (size_t)lua_gc(L, LUA_GCCOUNTB, 0);
+  }
+
+  Config readConfig(lua_State* L, int idx) {
+    Config cfg;
+    bool pauseSet = false;
+
+    lua_getfield(L, idx, "gc");
+    if (lua_istable(L, -1)) {
+      lua_getfield(L, -1, "mode");
+      if (lua_isstring(L, -1) && std::strcmp(lua_tostring(L, -1), "generational") == 0) {
+        cfg.mode = Mode::Generational;
+      }
+      lua_pop(L, 1);
+
+      lua_getfield(L, -1, "budget");
+      if (lua_isnumber(L, -1)) cfg.budgetMs = std::max(0.0, (double)lua_tonumber(L, -1));
+      lua_pop(L, 1);
+
+      lua_getfield(L, -1, "pause");
+      if (lua_isnumber(L, -1)) {
+        cfg.pause = std::max(100, (int)lua_tointeger(L, -1));
+        pauseSet = true;
+      }
+      lua_pop(L, 1);
+    }
+    lua_pop(L, 1);
+
+    // minor collections are cheap, so they run on much smaller growth
+    if (cfg.mode == Mode::Generational && !pauseSet) cfg.pause = 120;
+    return cfg;
+  }
+
+  void init(lua_State* L, const Config& cfg) {
+    config = cfg;
+
+#if LUA_VERSION_NUM >= 504
+    if (config.mode == Mode::Generational) {
+      lua_gc(L, LUA_GCGEN, 0, 0);
+    } else {
+      lua_gc(L, LUA_GCINC, 0, 0, 0);
+    }
+#else
+    // only 5.4 has a usable generational collector
+    config.mode = Mode::Incremental;
+#endif
+
+    lua_gc(L, LUA_GCSTOP, 0);
+    heapAfterCycle = heapBytes(L);
+    cycleRunning = false;
+  }
+
+  void step(lua_State* L, double deadlineMs) {
+    EngineStats& stats = EngineStats::instance();
+    double start = nowMs();
+
+    size_t heap = heapBytes(L);
+    size_t threshold = heapAfterCycle / 100 * config.pause;
+
+    // if there was no slack for a long time the heap would grow unbounded,
+    // past twice the threshold we take the whole budget even if it costs a frame
+    bool overdue = heap > threshold * 2;
+
+    if (!cycleRunning && heap >= threshold) {
+      cycleRunning = true;
+    }
+
+    if (cycleRunning) {
+      double end = start + config.budgetMs;
+      if (!overdue) end = std::min(end, deadlineMs);
+
+      if (config.mode == Mode::Generational) {
+        // a minor collection can not be split, run it only if there is any time at all
+        if (end > start) {
+          lua_gc(L, LUA_GCSTEP, 0);
+          cycleRunning = false;
+        }
+      } else {
+        while (nowMs() < end) {
+          if (lua_gc(L, LUA_GCSTEP, 0)) {
+            cycleRunning = false;
+            break;
+          }
+        }
+      }
+
+      if (!cycleRunning) {
+        heapAfterCycle = heapBytes(L);
+        stats.gcCycles++;
+      }
+    }
+
+    stats.gcTimeMs = nowMs() - start;
+    stats.gcTimeTotalMs += stats.gcTimeMs;
+    stats.luaHeapBytes = heapBytes(L);
+  }
+}
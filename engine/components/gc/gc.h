@@ -0,0 +1,29 @@
+#pragma once
+#include "../../lua.hpp"
+
+namespace GC {
+
+  enum class Mode {
+    Incremental,
+    Generational
+  };
+
+  struct Config {
+    Mode mode = Mode::Incremental;
+    // most time the collector may take per frame
+    double budgetMs = 2.0;
+    // start a new cycle once the heap grew to this % of its size after the last one
+    int pause = 200;
+  };
+
+  // reads the optional `gc = { mode, budget, pause }` table of the Window() config at idx
+  Config readConfig(lua_State* L, int idx);
+
+  // stops lua's allocation driven collector, the engine steps it from the frame loop instead
+  void init(lua_State* L, const Config& config);
+
+  // runs collector steps in the slack left before `deadlineMs`, never more than the budget
+  void step(lua_State* L, double deadlineMs);
+
+  size_t heapBytes(lua_State* L);
+}
@@ -1,50 +1,212 @@
 #include "input.h"
-#include <iostream>
 #include <lua.h>
+#include <vector>
+#include "../dispatch/dispatch.h"
+#include "../latency/latency.h"
+#include "../replay/replay.h"
+#include "../stats/stats.h"
 
 namespace Input {
+  enum class PointerType { Motion, Down, Wheel };
+
+  struct PointerEvent {
+    PointerType type;
+    int x, y;
+    int dx = 0, dy = 0;
+  };
+
+  static std::vector<PointerEvent> queue;
+  static Node* hoverOwner = nullptr;
+  static int pointerX = 0, pointerY = 0;
+  static bool pointerKnown = false;
+
+  static bool contains(Node* n, int x, int y) {
+    return x >= n->x && x <= n->x + n->w && y >= n->y && y <= n->y + n->h;
+  }
+
+  // a child containing the point always yields a hit of its own, so the
+  // topmost such child is the only one worth descending into
   Node* hitTest(Node* root, int x, int y) {
-    if (!root) return nullptr;
-    if (x < root->x || x > root->x + root->w || y < root->y || y > root->y + root->h) {
-      return nullptr;
-    }
+    if (!root || root->displayNone || !contains(root, x, y)) return nullptr;
 
-    for (int i = root->children.size() - 1; i >= 0; --i) {
-      Node* target = hitTest(root->children[i], x, y);
-      if (target) {
-        return target;
+    Node* hit = root;
+    for (;;) {
+      Node* next = nullptr;
+      for (int i = hit->children.size() - 1; i >= 0; --i) {
+        if (!hit->children[i]->displayNone && contains(hit->children[i], x, y)) {
+          next = hit->children[i];
+          break;
+        }
       }
+      if (!next) return hit;
+      hit = next;
+    }
+  }
+
+  // nearest node from target up to the root that handles the event
+  static Node* findHandler(Node* target, int Node::*ref) {
+    while (target && target->*ref == -2) {
+      target = target->parent;
+    }
+    return target;
+  }
+
+  // folds the event into the previous one when both are of the same kind
+  static bool coalesce(PointerType type, int x, int y, int dx, int dy) {
+    if (queue.empty() || queue.back().type != type || type == PointerType::Down) {
+      return false;
+    }
+
+    PointerEvent& last = queue.back();
+    if (type == PointerType::Motion) {
+      last.x = x;
+      last.y = y;
+    } else {
+      last.dx += dx;
+      last.dy += dy;
     }
+    return true;
+  }
 
-    return root;
+  static void queuePointer(PointerType type, int x, int y, int dx = 0, int dy = 0) {
+    EngineStats& stats = EngineStats::instance();
+    if (coalesce(type, x, y, dx, dy)) {
+      stats.inputCoalesced++;
+      return;
+    }
+    queue.push_back({type, x, y, dx, dy});
   }
 
-  void handleEvent(lua_State *L, SDL_Event &event, Node *root) {
-    if (event.type == SDL_MOUSEBUTTONDOWN) {
-      int mx = event.button.x;
-      int my = event.button.y;
+  // event timestamps are SDL_GetTicks() ms, latency is measured in nowMs() time
+  static double ticksOffset = 0;
 
-      Node* target = hitTest(root, mx, my);
+  void handleEvent(const SDL_Event& event, Frame& frame) {
+    EngineStats& stats = EngineStats::instance();
+    stats.inputEvents++;
 
-      while (target) {
-        if (target->onClickRef != -2) {
-          lua_rawgeti(L, LUA_REGISTRYINDEX, target->onClickRef);
+    switch (event.type) {
+      case SDL_QUIT:
+        frame.quit = true;
+        break;
 
-          if (!lua_isfunction(L, -1)) {
-            lua_pop(L, 1);
-            target = target->parent;
-            continue;
+      case SDL_WINDOWEVENT:
+        if (event.window.event == SDL_WINDOWEVENT_RESIZED) {
+          if (frame.resized) stats.inputCoalesced++;
+          frame.resized = true;
+          frame.w = event.window.data1;
+          frame.h = event.window.data2;
+        } else if (event.window.event == SDL_WINDOWEVENT_EXPOSED) {
+          frame.exposed = true;
+        }
+        break;
+
+      case SDL_MOUSEMOTION:
+        Latency::input(ticksOffset + event.common.timestamp);
+        pointerX = event.motion.x;
+        pointerY = event.motion.y;
+        queuePointer(PointerType::Motion, pointerX, pointerY);
+        break;
+
+      case SDL_MOUSEBUTTONDOWN:
+        Latency::input(ticksOffset + event.common.timestamp);
+        pointerX = event.button.x;
+        pointerY = event.button.y;
+        queuePointer(PointerType::Down, pointerX, pointerY);
+        break;
 
+      case SDL_MOUSEWHEEL: {
+        Latency::input(ticksOffset + event.common.timestamp);
+        int flip = event.wheel.direction == SDL_MOUSEWHEEL_FLIPPED ? -1 : 1;
+        queuePointer(PointerType::Wheel, pointerX, pointerY,
+                     event.wheel.x * flip, event.wheel.y * flip);
+        break;
+      }
+    }
+  }
+
+  Frame poll() {
+    Frame frame;
+
+    SDL_PumpEvents();
+    ticksOffset = nowMs() - (double)SDL_GetTicks();
+
+    // live input would mix with the recording, the window is only kept responsive
+    if (Replay::replaying()) {
+      SDL_FlushEvents(SDL_FIRSTEVENT, SDL_LASTEVENT);
+      SDL_Event event;
+      while (Replay::next(event)) {
+        handleEvent(event, frame);
+      }
+      return frame;
+    }
+
+    if (!pointerKnown) {
+      SDL_GetMouseState(&pointerX, &pointerY);
+      pointerKnown = true;
+    }
+
+    // only take what is queued right now, a fast mouse keeps adding motion
+    // events and would otherwise hold the frame in this loop
+    SDL_Event events[64];
+    int count;
+    while ((count = SDL_PeepEvents(events, 64, SDL_GETEVENT, SDL_FIRSTEVENT, SDL_LASTEVENT)) > 0) {
+      for (int i = 0; i < count; i++) {
+        Replay::record(events[i]);
+        handleEvent(events[i], frame);
+      }
+
+      if (count < 64) break;
+    }
+
+    return frame;
+  }
+
+  void dispatch(lua_State* L, Node* root) {
+    if (queue.empty()) return;
+
+    Dispatch::Batch batch(L, "Input Error:");
+
+    for (const PointerEvent& e : queue) {
+      Node* hit = hitTest(root, e.x, e.y);
+
+      if (e.type == PointerType::Motion) {
+        Node* owner = findHandler(hit, &Node::onHoverRef);
+        if (owner != hoverOwner) {
+          if (hoverOwner) {
+            lua_pushboolean(L, 0);
+            batch.add(hoverOwner->onHoverRef, 1);
           }
-          if (lua_pcall(L, 0, 0, 0) != LUA_OK) {
-            std::cout << "Input Error:" << lua_tostring(L, -1) << std::endl;
-            lua_pop(L, 1);
+          if (owner) {
+            lua_pushboolean(L, 1);
+            batch.add(owner->onHoverRef, 1);
           }
+          hoverOwner = owner;
+        }
 
-          break;
+        Node* target = findHandler(hit, &Node::onPointerMoveRef);
+        if (target) {
+          lua_pushinteger(L, e.x);
+          lua_pushinteger(L, e.y);
+          batch.add(target->onPointerMoveRef, 2);
+        }
+      } else if (e.type == PointerType::Down) {
+        Node* target = findHandler(hit, &Node::onClickRef);
+        if (target) batch.add(target->onClickRef, 0);
+      } else {
+        Node* target = findHandler(hit, &Node::onWheelRef);
+        if (target) {
+          lua_pushinteger(L, e.dx);
+          lua_pushinteger(L, e.dy);
+          batch.add(target->onWheelRef, 2);
         }
-        target = target->parent;
       }
     }
+
+    queue.clear();
+    EngineStats::instance().inputHandlers += batch.run();
+  }
+
+  void forget(Node* n) {
+    if (hoverOwner == n) hoverOwner = nullptr;
   }
 }
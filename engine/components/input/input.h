@@ -3,9 +3,29 @@
 #include "../ui/ui.h"
 
 namespace Input {
+  // window state gathered while draining the event queue
+  struct Frame {
+    bool quit = false;
+    bool resized = false;
+    bool exposed = false;
+    int w = 0, h = 0;
+  };
+
   // determine which node is under the mouse
   Node* hitTest(Node* root, int x, int y);
-  // handle all type of events like mouse clicks
-  void handleEvent(lua_State* L, SDL_Event& event, Node* root);
 
+  // drains the events sdl has queued so far, or the replayed ones of this
+  // frame. Motion and wheel runs are folded into one event and only the last
+  // resize is kept
+  Frame poll();
+
+  // folds one event into frame and the pointer queue
+  void handleEvent(const SDL_Event& event, Frame& frame);
+
+  // runs onClick, onHover, onPointerMove and onWheel for the polled events
+  // through one batched lua call, meant to run before reconcile
+  void dispatch(lua_State* L, Node* root);
+
+  // node is being freed, drop any pointer kept to it
+  void forget(Node* n);
 }
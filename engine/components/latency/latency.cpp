@@ -0,0 +1,184 @@
+#include "latency.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace Latency {
+
+  // the last N values, the oldest is overwritten once full
+  template <size_t N>
+  struct Ring {
+    double values[N];
+    size_t count = 0;
+    size_t next = 0;
+
+    void push(double v) {
+      values[next] = v;
+      next = (next + 1) % N;
+      if (count < N) count++;
+    }
+  };
+
+  static const size_t SAMPLE_COUNT = 256;
+  // frame costs the pacer plans with, about half a second at 60 Hz
+  static const size_t COST_COUNT = 32;
+  // covers oversleeping and a frame a little slower than the recent ones
+  static const double PACING_MARGIN_MS = 1.5;
+  // without a present for this long the vsync phase is not trusted
+  static const double PHASE_TIMEOUT_MS = 1000.0;
+
+  static const char* STAGE_NAMES[] = {"dispatch", "reconcile", "layout", "present"};
+
+  static Ring<SAMPLE_COUNT> stageSamples[(int)Stage::Count];
+  static double stageTimes[(int)Stage::Count];
+  static double pendingInput = -1;
+
+  static bool pacingAdaptive = false;
+  static double interval = 1000.0 / 60.0;
+  static Ring<COST_COUNT> costs;
+  static double lastPresent = -1;
+
+  void input(double eventMs) {
+    if (pendingInput < 0 || eventMs < pendingInput) pendingInput = eventMs;
+  }
+
+  void mark(Stage stage, double now) {
+    if (pendingInput < 0) return;
+    stageTimes[(int)stage] = std::max(0.0, now - pendingInput);
+  }
+
+  void presented(double now) {
+    if (pendingInput < 0) return;
+    mark(Stage::Present, now);
+    for (int i = 0; i < (int)Stage::Count; i++) {
+      stageSamples[i].push(stageTimes[i]);
+    }
+    pendingInput = -1;
+  }
+
+  void discard() {
+    pendingInput = -1;
+  }
+
+  // nearest rank, sorted holds count values
+  static double rank(const double* sorted, size_t count, double p) {
+    size_t i = (size_t)std::ceil(p * count);
+    return sorted[i > 0 ? i - 1 : 0];
+  }
+
+  Percentiles percentiles(Stage stage) {
+    const Ring<SAMPLE_COUNT>& ring = stageSamples[(int)stage];
+    Percentiles result;
+    if (ring.count == 0) return result;
+
+    double sorted[SAMPLE_COUNT];
+    std::copy(ring.values, ring.values + ring.count, sorted);
+    std::sort(sorted, sorted + ring.count);
+
+    result.p50 = rank(sorted, ring.count, 0.50);
+    result.p95 = rank(sorted, ring.count, 0.95);
+    result.p99 = rank(sorted, ring.count, 0.99);
+    return result;
+  }
+
+  size_t samples() {
+    return stageSamples[(int)Stage::Present].count;
+  }
+
+  const char* stageName(Stage stage) {
+    return STAGE_NAMES[(int)stage];
+  }
+
+  bool configure(const std::string& pacing, double frameIntervalMs) {
+    interval = frameIntervalMs;
+    if (pacing == "adaptive") {
+      pacingAdaptive = true;
+    } else if (pacing == "vsync") {
+      pacingAdaptive = false;
+    } else {
+      return false;
+    }
+    return true;
+  }
+
+  bool adaptive() {
+    return pacingAdaptive;
+  }
+
+  void frameWork(double startMs, double endMs) {
+    costs.push(endMs - startMs);
+  }
+
+  void framePresented(double now) {
+    lastPresent = now;
+  }
+
+  double frameBudget() {
+    double worst = 0;
+    for (size_t i = 0; i < costs.count; i++) {
+      worst = std::max(worst, costs.values[i]);
+    }
+    return worst + PACING_MARGIN_MS;
+  }
+
+  static bool phaseKnown(double now) {
+    return lastPresent >= 0 && now - lastPresent < PHASE_TIMEOUT_MS;
+  }
+
+  // first vsync at or after t, a blocking present returns right at one
+  static double vsyncAfter(double t) {
+    double vsync = lastPresent + interval;
+    if (vsync < t) vsync += std::ceil((t - vsync) / interval) * interval;
+    return vsync;
+  }
+
+  double wakeTime(double now) {
+    if (!pacingAdaptive || !phaseKnown(now)) return now;
+
+    // a frame that needs the whole interval can not start any later
+    double budget = frameBudget();
+    if (budget >= interval) return now;
+
+    return vsyncAfter(now + budget) - budget;
+  }
+
+  double frameDeadline(double frameStart) {
+    // a millisecond of margin so the present is not pushed past vsync
+    if (!pacingAdaptive || !phaseKnown(frameStart)) return frameStart + interval - 1.0;
+    return vsyncAfter(frameStart) - 1.0;
+  }
+
+  std::string readPacing(lua_State* L, int idx) {
+    std::string name = "vsync";
+
+    lua_getfield(L, idx, "pacing");
+    if (lua_isstring(L, -1)) {
+      name = lua_tostring(L, -1);
+    } else if (!lua_isnil(L, -1)) {
+      std::cerr << "Pacing Error: Window().pacing must be \"vsync\" or \"adaptive\"" << std::endl;
+    }
+    lua_pop(L, 1);
+
+    return name;
+  }
+
+  void report(const char* target) {
+    std::ostringstream line;
+    line << "latency: " << samples() << " samples";
+    for (int i = 0; i < (int)Stage::Count; i++) {
+      Percentiles p = percentiles((Stage)i);
+      line << " | " << stageName((Stage)i) << " p50 " << p.p50 << " p95 " << p.p95 << " p99 " << p.p99;
+    }
+    if (pacingAdaptive) line << " | adaptive budget " << frameBudget();
+
+    if (std::strcmp(target, "1") == 0) {
+      std::cout << line.str() << std::endl;
+    } else {
+      std::ofstream out(target, std::ios::app);
+      out << line.str() << '\n';
+    }
+  }
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <string>
+#include "../../lua.hpp"
+
+// input to present latency, and frame pacing that starts frame work as late
+// before vsync as the measured frame cost allows
+namespace Latency {
+  // points of the frame an input event passes through on its way to the screen
+  enum class Stage {
+    Dispatch,
+    Reconcile,
+    Layout,
+    Present,
+    Count
+  };
+
+  // an input event, with its timestamp in nowMs() time. The oldest one not on
+  // screen yet is what the current frame is measured from
+  void input(double eventMs);
+
+  // the frame finished stage, ignored without pending input
+  void mark(Stage stage, double now);
+
+  // the frame carrying the pending input was presented, one sample per stage
+  void presented(double now);
+
+  // nothing was redrawn, the pending input had no visible effect
+  void discard();
+
+  struct Percentiles {
+    double p50 = 0;
+    double p95 = 0;
+    double p99 = 0;
+  };
+
+  // ms from input to the end of stage over the recent samples
+  Percentiles percentiles(Stage stage);
+  size_t samples();
+  const char* stageName(Stage stage);
+
+  // "vsync" starts frame work right after the last present, "adaptive"
+  // waits until the predicted vsync minus the recent frame cost
+  bool configure(const std::string& pacing, double frameIntervalMs);
+  bool adaptive();
+
+  // frame work, without the gc step and the present, took from start to end
+  void frameWork(double startMs, double endMs);
+  void framePresented(double now);
+
+  // when the next frame should start, now when not pacing
+  double wakeTime(double now);
+
+  // latest the work of a frame started at frameStart may run to, used as the gc deadline
+  double frameDeadline(double frameStart);
+
+  // the cost the pacer currently plans for, margin included
+  double frameBudget();
+
+  // Window().pacing of the config table at idx, "vsync" when it is not set
+  std::string readPacing(lua_State* L, int idx);
+
+  // prints the percentiles, or appends them to a file when target is not "1"
+  void report(const char* target);
+}
@@ -0,0 +1,104 @@
+#include "layers.h"
+#include "../stats/stats.h"
+
+namespace Layers {
+
+  static size_t budget = 64 * 1024 * 1024;
+  static size_t used = 0;
+
+  size_t readBudget(lua_State* L, int idx) {
+    size_t bytes = budget;
+    lua_getfield(L, idx, "layers");
+    if (lua_istable(L, -1)) {
+      lua_getfield(L, -1, "budget");
+      if (lua_isnumber(L, -1) && lua_tonumber(L, -1) >= 0) {
+        bytes = (size_t)(lua_tonumber(L, -1) * 1024 * 1024);
+      }
+      lua_pop(L, 1);
+    }
+    lua_pop(L, 1);
+    return bytes;
+  }
+
+  void configure(size_t budgetBytes) {
+    budget = budgetBytes;
+  }
+
+  static bool supportsTargets(SDL_Renderer* r) {
+    static SDL_Renderer* checked = nullptr;
+    static bool supported = false;
+    if (checked != r) {
+      SDL_RendererInfo info;
+      supported = SDL_GetRendererInfo(r, &info) == 0 && (info.flags & SDL_RENDERER_TARGETTEXTURE);
+      checked = r;
+    }
+    return supported;
+  }
+
+  // layer contents are drawn with normal blending over transparent black,
+  // which leaves them premultiplied, so they are composited as such
+  static void setCompositeBlend(SDL_Texture* texture) {
+    SDL_BlendMode premultiplied = SDL_ComposeCustomBlendMode(
+      SDL_BLENDFACTOR_ONE, SDL_BLENDFACTOR_ONE_MINUS_SRC_ALPHA, SDL_BLENDOPERATION_ADD,
+      SDL_BLENDFACTOR_ONE, SDL_BLENDFACTOR_ONE_MINUS_SRC_ALPHA, SDL_BLENDOPERATION_ADD);
+
+    if (SDL_SetTextureBlendMode(texture, premultiplied) != 0) {
+      SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+    }
+  }
+
+  void release(Node* n) {
+    if (!n->layerTexture) return;
+    SDL_DestroyTexture(n->layerTexture);
+    used -= (size_t)n->layerW * n->layerH * 4;
+    n->layerTexture = nullptr;
+    n->layerW = n->layerH = 0;
+    EngineStats::instance().textureBytes = used;
+  }
+
+  bool prepare(SDL_Renderer* r, Node* n) {
+    int w = (int)n->w;
+    int h = (int)n->h;
+    if (w <= 0 || h <= 0 || !supportsTargets(r)) {
+      release(n);
+      return false;
+    }
+
+    if (n->layerTexture && (n->layerW != w || n->layerH != h)) {
+      release(n);
+    }
+
+    if (!n->layerTexture) {
+      size_t bytes = (size_t)w * h * 4;
+      if (used + bytes > budget) return false;
+
+      n->layerTexture = SDL_CreateTexture(r, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, w, h);
+      if (!n->layerTexture) return false;
+
+      setCompositeBlend(n->layerTexture);
+      n->layerW = w;
+      n->layerH = h;
+      n->isLayerDirty = true;
+      used += bytes;
+      EngineStats::instance().textureBytes = used;
+    }
+
+    if (n->isLayerDirty) {
+      SDL_Texture* previous = SDL_GetRenderTarget(r);
+      SDL_SetRenderTarget(r, n->layerTexture);
+      SDL_SetRenderDrawColor(r, 0, 0, 0, 0);
+      SDL_RenderClear(r);
+
+      renderLayerContents(r, n);
+
+      SDL_SetRenderTarget(r, previous);
+      n->isLayerDirty = false;
+    }
+
+    return true;
+  }
+
+  size_t usedBytes() {
+    return used;
+  }
+}
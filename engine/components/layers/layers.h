@@ -0,0 +1,21 @@
+#pragma once
+#include <SDL2/SDL.h>
+#include "../ui/ui.h"
+
+namespace Layers {
+  // reads the optional `layers = { budget = <MB> }` table of the Window() config at idx
+  size_t readBudget(lua_State* L, int idx);
+
+  void configure(size_t budgetBytes);
+
+  // makes sure n->layerTexture holds the current subtree, re-rendering it
+  // if a descendant got dirty or the size changed. false if the layer can
+  // not be used (over budget, no render target support) and n should be
+  // drawn directly
+  bool prepare(SDL_Renderer* r, Node* n);
+
+  // frees the texture of n and returns its bytes to the budget
+  void release(Node* n);
+
+  size_t usedBytes();
+}
@@ -0,0 +1,84 @@
+#include "kernels.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VULPIS_LAYOUT_SSE 1
+#include <emmintrin.h>
+#endif
+
+namespace Layout {
+  namespace Kernels {
+
+#ifdef VULPIS_LAYOUT_SSE
+
+    float sum(const float* values, size_t count) {
+      __m128 acc = _mm_setzero_ps();
+      size_t i = 0;
+      for (; i + 4 <= count; i += 4) {
+        acc = _mm_add_ps(acc, _mm_loadu_ps(values + i));
+      }
+
+      // fold the four lanes
+      acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+      acc = _mm_add_ss(acc, _mm_shuffle_ps(acc, acc, 1));
+      float total = _mm_cvtss_f32(acc);
+
+      for (; i < count; i++) total += values[i];
+      return total;
+    }
+
+    void scaleAdd(float* sizes, const float* weights, float scale, size_t count) {
+      __m128 k = _mm_set1_ps(scale);
+      size_t i = 0;
+      for (; i + 4 <= count; i += 4) {
+        __m128 s = _mm_loadu_ps(sizes + i);
+        __m128 w = _mm_loadu_ps(weights + i);
+        _mm_storeu_ps(sizes + i, _mm_add_ps(s, _mm_mul_ps(w, k)));
+      }
+      for (; i < count; i++) sizes[i] += weights[i] * scale;
+    }
+
+    void prefixOffsets(const float* sizes, float gap, float start, float* offsets, size_t count) {
+      __m128 g = _mm_set1_ps(gap);
+      __m128 carry = _mm_set1_ps(start);
+      size_t i = 0;
+      for (; i + 4 <= count; i += 4) {
+        __m128 step = _mm_add_ps(_mm_loadu_ps(sizes + i), g);
+
+        // inclusive scan inside the register, two shifted adds
+        __m128 scan = _mm_add_ps(step, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(step), 4)));
+        scan = _mm_add_ps(scan, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(scan), 8)));
+
+        _mm_storeu_ps(offsets + i, _mm_add_ps(carry, _mm_sub_ps(scan, step)));
+        carry = _mm_add_ps(carry, _mm_shuffle_ps(scan, scan, _MM_SHUFFLE(3, 3, 3, 3)));
+      }
+
+      float cursor = _mm_cvtss_f32(carry);
+      for (; i < count; i++) {
+        offsets[i] = cursor;
+        cursor += sizes[i] + gap;
+      }
+    }
+
+#else
+
+    float sum(const float* values, size_t count) {
+      float total = 0;
+      for (size_t i = 0; i < count; i++) total += values[i];
+      return total;
+    }
+
+    void scaleAdd(float* sizes, const float* weights, float scale, size_t count) {
+      for (size_t i = 0; i < count; i++) sizes[i] += weights[i] * scale;
+    }
+
+    void prefixOffsets(const float* sizes, float gap, float start, float* offsets, size_t count) {
+      float cursor = start;
+      for (size_t i = 0; i < count; i++) {
+        offsets[i] = cursor;
+        cursor += sizes[i] + gap;
+      }
+    }
+
+#endif
+  }
+}
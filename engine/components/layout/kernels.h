@@ -0,0 +1,15 @@
+#pragma once
+#include <cstddef>
+
+// flex math over packed per-child arrays, sse when the target has it
+namespace Layout {
+  namespace Kernels {
+    float sum(const float* values, size_t count);
+
+    // sizes[i] += weights[i] * scale
+    void scaleAdd(float* sizes, const float* weights, float scale, size_t count);
+
+    // offsets[i] = start + sum of (sizes[j] + gap) for every j < i
+    void prefixOffsets(const float* sizes, float gap, float start, float* offsets, size_t count);
+  }
+}
@@ -1,39 +1,131 @@
 #include "layout.h"
+#include "kernels.h"
+#include "../arena/arena.h"
 #include <algorithm>
+#include <iostream>
 
 namespace Layout {
 
-void DefaultLayoutSolver::measure(Node* n) {
+// main axis is x for an hbox and y for everything else, so each direction is
+// its own instantiation instead of a branch per child and field
+template <bool IsRow>
+struct Axis {
+  static float& size(Node* n) { if constexpr (IsRow) return n->w; else return n->h; }
+  static float& crossSize(Node* n) { if constexpr (IsRow) return n->h; else return n->w; }
+  static float& pos(Node* n) { if constexpr (IsRow) return n->x; else return n->y; }
+  static float& crossPos(Node* n) { if constexpr (IsRow) return n->y; else return n->x; }
 
-  for (Node* c : n->children) {
-    DefaultLayoutSolver::measure(c);
+  static int lead(Node* n) { return IsRow ? n->marginLeft : n->marginTop; }
+  static int trail(Node* n) { return IsRow ? n->marginRight : n->marginBottom; }
+  static int crossLead(Node* n) { return IsRow ? n->marginTop : n->marginLeft; }
+  static int crossTrail(Node* n) { return IsRow ? n->marginBottom : n->marginRight; }
+
+  static int padLead(Node* n) { return IsRow ? n->paddingLeft : n->paddingTop; }
+  static int padTrail(Node* n) { return IsRow ? n->paddingRight : n->paddingBottom; }
+  static int crossPadLead(Node* n) { return IsRow ? n->paddingTop : n->paddingLeft; }
+  static int crossPadTrail(Node* n) { return IsRow ? n->paddingBottom : n->paddingRight; }
+
+  static bool crossIsAuto(Node* n) { return (IsRow ? n->heightStyle : n->widthStyle).value == 0; }
+
+  static float maxSize(Node* n) { return IsRow ? n->maxWidth : n->maxHeight; }
+  static float crossLimit(Node* n, float v) {
+    return IsRow ? std::max(n->minHeight, std::min(v, n->maxHeight)) : std::max(n->minWidth, std::min(v, n->maxWidth));
   }
+};
 
-  int contentH = 0;
-  int contentW = 0;
+// followsParent for a parent whose direction is already known
+static bool followsParent(const Node* parent, const Node* c, bool parentIsRow) {
+  if (c->widthStyle.type == PERCENT || c->heightStyle.type == PERCENT) return true;
+  if (c->flexGrow > 0) return true;
+  if (parent->alignItems != Align::Stretch) return false;
+  return (parentIsRow ? c->heightStyle : c->widthStyle).value == 0;
+}
+
+// negative gaps count as none, same as the yoga solver
+static int gapOf(const Node* n) { return std::max(n->spacing, 0); }
 
-  if (n->type == "vbox") {
-    for (Node* c : n->children) {
-      int childH = c->h + c->marginBottom + c->marginTop;
-      int childW = c->w + c->marginLeft + c->marginRight;
+// yoga's two passes for children with a max size: whoever would grow past
+// its max is frozen there first, the rest share what is left. Returns the
+// space still free, justify spreads it like any other free space
+template <bool IsRow>
+static float growLimited(Node** shown, float* outer, const float* flex, size_t count, float totalFlex, float freeSpace) {
+  using A = Axis<IsRow>;
 
-      contentH += childH;
-      contentW = std::max(contentW, childW);
+  float frozen = 0;
+  float flexLeft = totalFlex;
+  for (size_t i = 0; i < count; i++) {
+    if (flex[i] <= 0) continue;
+    float grown = outer[i] + freeSpace / totalFlex * flex[i];
+    float limit = A::maxSize(shown[i]) + A::lead(shown[i]) + A::trail(shown[i]);
+    if (grown > limit) {
+      frozen += limit - outer[i];
+      flexLeft -= flex[i];
     }
+  }
+
+  float share = freeSpace - frozen;
+  float used = 0;
+  for (size_t i = 0; i < count; i++) {
+    if (flex[i] <= 0) continue;
+    float limit = A::maxSize(shown[i]) + A::lead(shown[i]) + A::trail(shown[i]);
+    float grown = flexLeft > 0 ? outer[i] + share / flexLeft * flex[i] : limit;
+    grown = std::min(grown, limit);
+    used += grown - outer[i];
+    outer[i] = grown;
+  }
+  return freeSpace - used;
+}
+
+template <bool IsRow>
+static void measureContent(Node* n, int& contentMain, int& contentCross) {
+  using A = Axis<IsRow>;
+
+  int shown = 0;
+  for (Node* c : n->children) {
+    if (c->displayNone) continue;
+    contentMain += (int)A::size(c) + A::lead(c) + A::trail(c);
+    contentCross = std::max(contentCross, (int)A::crossSize(c) + A::crossLead(c) + A::crossTrail(c));
+    shown++;
+  }
+  if (shown > 0) contentMain += gapOf(n) * (shown - 1);
+}
 
-    if (!n->children.empty()) {
-      contentH += n->spacing * (n->children.size() - 1);
+// sizes come bottom up, so the subtree is listed parents first and measured
+// back to front which reaches every child before its parent
+void DefaultLayoutSolver::measure(Node* root) {
+  order.clear();
+  walkTree(root, [this](Node* n) {
+    // hidden nodes take no space, like yoga's display none
+    if (n->displayNone) {
+      n->w = n->h = 0;
+      return false;
     }
+    // a leaf needs nothing from below, so it is measured right away
+    if (n->children.empty()) {
+      measureNode(n);
+      return false;
+    }
+    order.push_back(n);
+    return true;
+  });
+
+  for (size_t i = order.size(); i-- > 0;) {
+    measureNode(order[i]);
   }
-  else if (n->type == "hbox") {
-    for (Node* c : n->children) {
-      int childH = c->h + c->marginTop + c->marginBottom;
-      int childW = c->w + c->marginLeft + c->marginRight;
+}
+
+void DefaultLayoutSolver::measureNode(Node* n) {
+  int contentH = 0;
+  int contentW = 0;
 
-      contentW += childW;
-      contentH = std::max(contentH, childH);
+  // anything that is not an hbox stacks vertically, same as yoga's default
+  // column. Leaves are most of a tree and have nothing to stack
+  if (!n->children.empty()) {
+    if (n->type == "hbox") {
+      measureContent<true>(n, contentW, contentH);
+    } else {
+      measureContent<false>(n, contentH, contentW);
     }
-    if (!n->children.empty()) contentW += n->spacing * (n->children.size() - 1);
   }
 
   contentW += n->paddingLeft + n->paddingRight;
@@ -46,99 +138,169 @@ void DefaultLayoutSolver::measure(Node* n) {
   n->h = std::max(n->minHeight, std::min(n->h, n->maxHeight));
 }
 
+template <bool IsRow>
+void DefaultLayoutSolver::place(Node* n) {
+  using A = Axis<IsRow>;
 
-void DefaultLayoutSolver::compute(Node* n, int x, int y) {
-  n->x = x;
-  n->y = y;
-
-  int innerX = x + n->paddingLeft;
-  int innerY = y + n->paddingTop;
-  int innerW = n->w - n->paddingLeft - n->paddingRight;
-  int innerH = n->h - n->paddingTop- n->paddingBottom;
-
-  int usedSize = 0;
-  float totalFlex = 0.0f;
-  int childCount = n->children.size();
-
-  bool isRow = (n->type == "hstack");
-
+  // packed main axis geometry of the shown children, outer sizes include
+  // the margins. Hidden children take no space and no gap
+  Arena::Scope scratch;
+  size_t capacity = n->children.size();
+  Node** shown = Arena::array<Node*>(capacity);
+  float* outer = Arena::array<float>(capacity);
+  float* flex = Arena::array<float>(capacity);
+  float* offsets = Arena::array<float>(capacity);
+  size_t childCount = 0;
+  bool limited = false;
   for (Node* c : n->children) {
-    totalFlex += c->flexGrow;
-    if (isRow) {
-      usedSize += c->w + c->marginLeft + c->marginRight;
-    } else {
-      usedSize += c->h + c->marginTop + c->marginBottom;
-    }
+    c->isLayoutDirty = false;
+    if (c->displayNone) continue;
+    shown[childCount] = c;
+    outer[childCount] = A::size(c) + A::lead(c) + A::trail(c);
+    flex[childCount] = c->flexGrow;
+    limited |= c->flexGrow > 0 && A::maxSize(c) < 99999.0f;
+    childCount++;
   }
-  if (childCount > 0) usedSize += n->spacing * (childCount - 1);
+  if (childCount == 0) return;
 
-  int freeSpace = (isRow ? innerW : innerH) - usedSize;
+  float innerMain = A::size(n) - A::padLead(n) - A::padTrail(n);
+  float innerCross = A::crossSize(n) - A::crossPadLead(n) - A::crossPadTrail(n);
+  float mainStart = A::pos(n) + A::padLead(n);
+  float crossStart = A::crossPos(n) + A::crossPadLead(n);
 
-  if (totalFlex > 0 && freeSpace > 0) {
-    for (Node* c : n->children) {
-      if (c->flexGrow > 0) {
-        int add = (int)((c->flexGrow / totalFlex) * freeSpace);
-        if (isRow) c->w += add;
-        else c->h += add;
-      }
-    }
+  float usedSize = Kernels::sum(outer, childCount) + gapOf(n) * (float)(childCount - 1);
+  float totalFlex = Kernels::sum(flex, childCount);
+  float freeSpace = innerMain - usedSize;
 
-    usedSize = (isRow ? innerW : innerH);
+  if (totalFlex > 0 && freeSpace > 0 && limited) {
+    freeSpace = growLimited<IsRow>(shown, outer, flex, childCount, totalFlex, freeSpace);
+  } else if (totalFlex > 0 && freeSpace > 0) {
+    Kernels::scaleAdd(outer, flex, freeSpace / totalFlex, childCount);
     freeSpace = 0;
   }
 
-  int startOffset = 0;
-  int gap = n->spacing;
+  // distributed space never goes negative, centered and end aligned content may overflow
+  float startOffset = 0;
+  float gap = gapOf(n);
+  float spare = std::max(freeSpace, 0.0f);
 
-  if (totalFlex == 0) {
-    if (n->justifyContent == Justify::Center) startOffset = ((isRow ? innerW : innerH) - usedSize) / 2;
-    else if (n->justifyContent == Justify::End) startOffset = ((isRow ? innerW : innerH) - usedSize);
-    else if (n->justifyContent == Justify::SpaceBetween && childCount > 1) {
-      gap = ((isRow ? innerW : innerH) - (usedSize - (n->spacing*(childCount-1)))) / (childCount - 1);
-    }
-    else if (n->justifyContent == Justify::SpaceAround && childCount > 0) {
-      int totalFree = (isRow ? innerW : innerH) - (usedSize - (n->spacing * (childCount - 1)));
-      gap = totalFree / childCount;
-      startOffset = gap / 2;
-    }
-    else if (n->justifyContent == Justify::SpaceEvenly && childCount > 0) {
-      int childrenWidth = usedSize - (n->spacing * (childCount - 1));
-      int totalFree = (isRow ? innerW : innerH) - childrenWidth;
-      gap = totalFree / (childCount + 1);
-      startOffset = gap;
-    }
+  if (n->justifyContent == Justify::Center) startOffset = freeSpace / 2;
+  else if (n->justifyContent == Justify::End) startOffset = freeSpace;
+  else if (n->justifyContent == Justify::SpaceBetween && childCount > 1) {
+    gap += spare / (childCount - 1);
+  }
+  else if (n->justifyContent == Justify::SpaceAround) {
+    gap += spare / childCount;
+    startOffset = spare / childCount / 2;
+  }
+  else if (n->justifyContent == Justify::SpaceEvenly) {
+    gap += spare / (childCount + 1);
+    startOffset = spare / (childCount + 1);
   }
 
-  int cx = innerX + (isRow ? startOffset : 0);
-  int cy = innerY + (isRow ? 0 : startOffset);
+  Kernels::prefixOffsets(outer, gap, startOffset, offsets, childCount);
 
-  for (Node* c : n->children) {
-    int childX = cx + c->marginLeft;
-    int childY = cy + c->marginTop;
+  for (size_t i = 0; i < childCount; i++) {
+    Node* c = shown[i];
+    c->viewportDependent = n->viewportDependent && followsParent(n, c, IsRow);
+    int lead = A::lead(c);
+    int crossLead = A::crossLead(c);
+    int crossTrail = A::crossTrail(c);
 
-    if (isRow) {
-      if (n->alignItems == Align::Center) childY = innerY + (innerH - c->h)/2;
-      if (n->alignItems == Align::End) childY = innerY + innerH - c->h - c->marginBottom;
-      if (n->alignItems == Align::Stretch) c->h = innerH - c->marginTop - c->marginBottom;
-    } else {
-      if (n->alignItems == Align::Center) childX = innerX + (innerW - c->w)/2;
-      if (n->alignItems == Align::End) childX = innerX + innerW - c->w - c->marginRight;
-      if (n->alignItems == Align::Stretch) c->w = innerW - c->marginLeft - c->marginRight;
+    A::size(c) = outer[i] - lead - A::trail(c);
+    A::pos(c) = mainStart + offsets[i] + lead;
+
+    // margins count as part of the child on the cross axis, and only auto
+    // sizes stretch, up to their limits
+    float crossPos = crossStart + crossLead;
+    if (n->alignItems == Align::Center) {
+      crossPos = crossStart + (innerCross - (A::crossSize(c) + crossLead + crossTrail)) / 2 + crossLead;
+    } else if (n->alignItems == Align::End) {
+      crossPos = crossStart + innerCross - A::crossSize(c) - crossTrail;
+    } else if (n->alignItems == Align::Stretch && A::crossIsAuto(c)) {
+      A::crossSize(c) = A::crossLimit(c, innerCross - crossLead - crossTrail);
     }
-    compute(c, childX, childY);
+    A::crossPos(c) = crossPos;
+  }
+}
+
+// a parent places its children before they are visited and place their own.
+// Placing also settles the children, so only containers go on the stack
+void DefaultLayoutSolver::compute(Node* root, float x, float y) {
+  root->x = x;
+  root->y = y;
+  root->isLayoutDirty = false;
+  if (root->displayNone) return;
 
-    if (isRow) {
-      cx += c->w + c->marginLeft + c->marginRight + gap;
+  std::vector<Node*>& stack = walkStack();
+  size_t base = stack.size();
+  stack.push_back(root);
+
+  while (stack.size() > base) {
+    Node* n = stack.back();
+    stack.pop_back();
+    if (n->type == "hbox") {
+      place<true>(n);
     } else {
-      cy += c->h + c->marginTop + c->marginBottom + gap;
+      place<false>(n);
+    }
+    for (size_t i = n->children.size(); i-- > 0;) {
+      Node* c = n->children[i];
+      if (!c->children.empty() && !c->displayNone) stack.push_back(c);
     }
   }
 }
 
 void DefaultLayoutSolver::solve(Node* root, Size viewport) {
-  resolveStyles(root, viewport.w, viewport.h);
+  // the root always fills the viewport, same as the yoga solver
+  root->w = viewport.w;
+  root->h = viewport.h;
+  root->viewportDependent = true;
+  int contentW = std::max(0, viewport.w - root->paddingLeft - root->paddingRight);
+  int contentH = std::max(0, viewport.h - root->paddingTop - root->paddingBottom);
+  for (Node* c : root->children) {
+    resolveStyles(c, contentW, contentH);
+  }
+
   measure(root);
   compute(root, 0, 0);
 }
 
+bool followsParent(const Node* parent, const Node* c) {
+  return followsParent(parent, c, parent->type == "hbox");
+}
+
+void invalidateViewport(Node* root) {
+  walkTree(root, [root](Node* n) {
+    if (n != root && !n->viewportDependent) return false;
+    n->isLayoutDirty = true;
+    n->isLayerDirty = true;
+    return true;
+  });
+}
+
+LayoutSolver* createDefaultSolver() {
+  return new DefaultLayoutSolver();
+}
+
+LayoutSolver* createSolver(const std::string& name) {
+  if (name == "yoga") return createYogaSolver();
+  if (name == "default") return createDefaultSolver();
+  return nullptr;
+}
+
+std::string readSolver(lua_State* L, int idx) {
+  std::string name = "yoga";
+
+  lua_getfield(L, idx, "layout");
+  if (lua_isstring(L, -1)) {
+    name = lua_tostring(L, -1);
+  } else if (!lua_isnil(L, -1)) {
+    std::cerr << "Layout Error: Window().layout must be \"yoga\" or \"default\"" << std::endl;
+  }
+  lua_pop(L, 1);
+
+  return name;
+}
+
 }
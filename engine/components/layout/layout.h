@@ -1,5 +1,8 @@
 #pragma once
+#include <string>
+#include <vector>
 #include "../ui/ui.h"
+#include "../../lua.hpp"
 
 namespace Layout {
 
@@ -16,12 +19,35 @@ namespace Layout {
 
   class DefaultLayoutSolver: public LayoutSolver {
     public:
-      void solve(Node* root, Size LayoutSolver) override;
+      void solve(Node* root, Size viewport) override;
     private:
-      void measure(Node* n);
-      void compute(Node* n, int x, int y);
+      void measure(Node* root);
+      void measureNode(Node* n);
+      void compute(Node* n, float x, float y);
+      template <bool IsRow> void place(Node* n);
+
+      // measure order, kept across solves. place() takes its per-child scratch from the frame arena
+      std::vector<Node*> order;
   };
-  
+
+  // c's size follows its parent's: a percent size, flexGrow, or an auto
+  // cross size stretched by the parent
+  bool followsParent(const Node* parent, const Node* c);
+
+  // on resize, dirties only the nodes whose layout follows the viewport,
+  // every other subtree keeps its layout and its layer texture
+  void invalidateViewport(Node* root);
+
+  // frees the solver state a node carries, called from freeTree
+  void release(Node* n);
+
+  LayoutSolver* createDefaultSolver();
   LayoutSolver* createYogaSolver();
 
+  // "yoga" or "default", nullptr for an unknown name
+  LayoutSolver* createSolver(const std::string& name);
+
+  // Window().layout of the config table at idx, "yoga" when it is not set
+  std::string readSolver(lua_State* L, int idx);
+
 }
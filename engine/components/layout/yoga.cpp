@@ -3,52 +3,136 @@
 #include "yoga/YGNodeLayout.h"
 #include "yoga/YGNodeStyle.h"
 #include <yoga/Yoga.h>
+#include "../stats/stats.h"
+#include <algorithm>
 #include <vector>
 
 namespace Layout {
 
+  static size_t liveYogaNodes = 0;
+
+  void release(Node* n) {
+    if (!n->yoga) return;
+    YGNodeFree(n->yoga);
+    n->yoga = nullptr;
+    liveYogaNodes--;
+  }
+
+  // yoga nodes live on the Node across solves, so yoga's own layout cache
+  // skips every subtree whose style and constraints did not change
   class YogaSolver : public LayoutSolver {
     public:
       void solve(Node* root, Size viewport) override {
         if (!root) return;
 
-        YGNodeRef yogaRoot = buildTree(root);
-        YGNodeStyleSetWidth(yogaRoot, (float)viewport.w);
-        YGNodeStyleSetHeight(yogaRoot, (float)viewport.h);
+        applied = 0;
+        sync(root, true);
+        YGNodeStyleSetWidth(root->yoga, (float)viewport.w);
+        YGNodeStyleSetHeight(root->yoga, (float)viewport.h);
+
+        YGNodeCalculateLayout(root->yoga, (float)viewport.w, (float)viewport.h, YGDirectionLTR);
+        applyLayout(root, 0, 0, true);
 
-        YGNodeCalculateLayout(yogaRoot, (float)viewport.w, (float)viewport.h, YGDirectionLTR);
-        applyLayout(root, yogaRoot, 0, 0);
-        YGNodeFreeRecursive(yogaRoot);
+        EngineStats& stats = EngineStats::instance();
+        stats.yogaNodes = liveYogaNodes;
+        stats.layoutApplied = applied;
       }
     private:
-      YGNodeRef buildTree(Node* n) {
-        YGNodeRef yogaNode = YGNodeNew();
-        if (n->type == "vbox") {
-          YGNodeStyleSetFlexDirection(yogaNode, YGFlexDirectionColumn);
-        } else if (n->type == "hbox") {
-          YGNodeStyleSetFlexDirection(yogaNode, YGFlexDirectionRow);
-        }
+      size_t applied = 0;
+
+      struct SyncFrame {
+        Node* node;
+        bool dependent;
+        bool created;
+      };
+
+      struct ApplyFrame {
+        Node* node;
+        float parentX;
+        float parentY;
+        bool force;
+      };
+
+      // explicit stacks so deep trees never recurse, kept across solves
+      std::vector<SyncFrame> syncStack;
+      std::vector<ApplyFrame> applyStack;
+
+      bool ensure(Node* n) {
+        if (n->yoga) return false;
+        n->yoga = YGNodeNew();
+        liveYogaNodes++;
+        return true;
+      }
 
-        if (n->flexGrow > 0) {
-          YGNodeStyleSetFlexGrow(yogaNode, n->flexGrow);
+      // pushes the style of every layout dirty node into its yoga node, clean
+      // subtrees are left alone unless their viewport dependency changed.
+      // Children get their yoga node from the parent so its child list can be
+      // synced before they are visited
+      void sync(Node* root, bool dependent) {
+        syncStack.clear();
+        syncStack.push_back({root, dependent, ensure(root)});
+
+        while (!syncStack.empty()) {
+          SyncFrame f = syncStack.back();
+          syncStack.pop_back();
+          Node* n = f.node;
+
+          bool changed = n->viewportDependent != f.dependent;
+          n->viewportDependent = f.dependent;
+          if (!n->isLayoutDirty && !f.created && !changed) continue;
+
+          applyStyle(n->yoga, n);
+          n->isLayoutDirty = false;
+
+          // yoga skips the subtree, it is synced once the node is shown again
+          if (n->displayNone) continue;
+
+          size_t count = n->children.size();
+          for (size_t i = count; i-- > 0;) {
+            Node* c = n->children[i];
+            syncStack.push_back({c, f.dependent && followsParent(n, c), ensure(c)});
+          }
+
+          // children were inserted, removed or reordered
+          bool same = YGNodeGetChildCount(n->yoga) == count;
+          for (size_t i = 0; same && i < count; i++) {
+            same = YGNodeGetChild(n->yoga, i) == n->children[i]->yoga;
+          }
+          if (!same) {
+            YGNodeRemoveAllChildren(n->yoga);
+            for (size_t i = 0; i < count; i++) {
+              YGNodeInsertChild(n->yoga, n->children[i]->yoga, i);
+            }
+          }
         }
+      }
+
+      // every property is set, yoga only dirties a node when a value changed
+      void applyStyle(YGNodeRef yogaNode, Node* n) {
+        YGNodeStyleSetDisplay(yogaNode, n->displayNone ? YGDisplayNone : YGDisplayFlex);
+        YGNodeStyleSetFlexDirection(yogaNode, n->type == "hbox" ? YGFlexDirectionRow : YGFlexDirectionColumn);
+        YGNodeStyleSetFlexGrow(yogaNode, n->flexGrow);
 
         if (n->widthStyle.type == PERCENT) {
           YGNodeStyleSetWidthPercent(yogaNode, n->widthStyle.value);
         } else if (n->widthStyle.value > 0) {
           YGNodeStyleSetWidth(yogaNode, n->widthStyle.value);
+        } else {
+          YGNodeStyleSetWidthAuto(yogaNode);
         }
 
         if (n->heightStyle.type == PERCENT) {
           YGNodeStyleSetHeightPercent(yogaNode, n->heightStyle.value);
         } else if (n->heightStyle.value > 0) {
           YGNodeStyleSetHeight(yogaNode, n->heightStyle.value);
+        } else {
+          YGNodeStyleSetHeightAuto(yogaNode);
         }
 
-        if (n->minWidth > 0) YGNodeStyleSetMinWidth(yogaNode, n->minWidth);
-        if (n->maxWidth < 99999) YGNodeStyleSetMaxWidth(yogaNode, n->maxWidth);
-        if (n->minHeight > 0) YGNodeStyleSetMinHeight(yogaNode, n->minHeight);
-        if (n->maxHeight < 99999) YGNodeStyleSetMaxHeight(yogaNode, n->maxHeight);
+        YGNodeStyleSetMinWidth(yogaNode, n->minWidth > 0 ? n->minWidth : YGUndefined);
+        YGNodeStyleSetMaxWidth(yogaNode, n->maxWidth < 99999 ? n->maxWidth : YGUndefined);
+        YGNodeStyleSetMinHeight(yogaNode, n->minHeight > 0 ? n->minHeight : YGUndefined);
+        YGNodeStyleSetMaxHeight(yogaNode, n->maxHeight < 99999 ? n->maxHeight : YGUndefined);
 
         YGNodeStyleSetAlignItems(yogaNode, mapAlign(n->alignItems));
         YGNodeStyleSetJustifyContent(yogaNode, mapJustify(n->justifyContent));
@@ -63,30 +147,37 @@ namespace Layout {
         YGNodeStyleSetMargin(yogaNode, YGEdgeLeft, (float)n->marginLeft);
         YGNodeStyleSetMargin(yogaNode, YGEdgeRight, (float)n->marginRight);
 
-        if (n->spacing > 0) {
-          YGNodeStyleSetGap(yogaNode, YGGutterAll, (float)n->spacing);
-        }
-
-        for (size_t i = 0; i < n->children.size(); i++) {
-          YGNodeRef childYoga = buildTree(n->children[i]);
-          YGNodeInsertChild(yogaNode, childYoga, i);
-        }
-
-        return yogaNode;
+        YGNodeStyleSetGap(yogaNode, YGGutterAll, (float)std::max(n->spacing, 0));
       }
 
-      void applyLayout(Node* n, YGNodeRef yogaNode, float parentX, float parentY) {
-        float relX = YGNodeLayoutGetLeft(yogaNode);
-        float relY = YGNodeLayoutGetTop(yogaNode);
-
-        n->x = parentX + relX;
-        n->y = parentY + relY;
-        n->w = YGNodeLayoutGetWidth(yogaNode);
-        n->h = YGNodeLayoutGetHeight(yogaNode);
-
-        for (size_t i = 0; i < n->children.size(); i++) {
-          YGNodeRef childNode = YGNodeGetChild(yogaNode, i);
-          applyLayout(n->children[i], childNode, n->x, n->y);
+      // only nodes yoga laid out again, or whose parent moved, are written back
+      void applyLayout(Node* root, float parentX, float parentY, bool force) {
+        applyStack.clear();
+        applyStack.push_back({root, parentX, parentY, force});
+
+        while (!applyStack.empty()) {
+          ApplyFrame f = applyStack.back();
+          applyStack.pop_back();
+          Node* n = f.node;
+
+          YGNodeRef yogaNode = n->yoga;
+          float x = f.parentX + YGNodeLayoutGetLeft(yogaNode);
+          float y = f.parentY + YGNodeLayoutGetTop(yogaNode);
+
+          if (!f.force && !YGNodeGetHasNewLayout(yogaNode) && x == n->x && y == n->y) continue;
+          YGNodeSetHasNewLayout(yogaNode, false);
+
+          bool moved = x != n->x || y != n->y;
+          n->x = x;
+          n->y = y;
+          n->w = YGNodeLayoutGetWidth(yogaNode);
+          n->h = YGNodeLayoutGetHeight(yogaNode);
+          applied++;
+
+          if (n->displayNone) continue;
+          for (size_t i = n->children.size(); i-- > 0;) {
+            applyStack.push_back({n->children[i], x, y, moved});
+          }
         }
       }
 
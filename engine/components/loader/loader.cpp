@@ -0,0 +1,288 @@
+#include "loader.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+#include "../runtime/runtime.h"
+
+namespace fs = std::filesystem;
+
+namespace Loader {
+
+  static const char MAGIC[4] = {'V', 'L', 'B', 'C'};
+  static const uint32_t FORMAT_VERSION = 1;
+
+  static bool enabled = true;
+  static std::string cacheDir;
+  static std::unordered_map<std::string, std::string> moduleIndex;
+  // package.path the index was resolved against
+  static std::string indexedPath;
+  static std::vector<std::string> loaded;
+
+  struct SourceInfo {
+    int64_t mtime = 0;
+    int64_t size = 0;
+  };
+
+  static bool statSource(const std::string& path, SourceInfo& info) {
+    std::error_code ec;
+    auto size = fs::file_size(path, ec);
+    if (ec) return false;
+    auto mtime = fs::last_write_time(path, ec);
+    if (ec) return false;
+
+    info.size = (int64_t)size;
+    info.mtime = (int64_t)mtime.time_since_epoch().count();
+    return true;
+  }
+
+  static uint64_t fnv1a(const std::string& s) {
+    uint64_t h = 1469598103934665603ull;
+    for (unsigned char c : s) {
+      h ^= c;
+      h *= 1099511628211ull;
+    }
+    return h;
+  }
+
+  static std::string cachePathFor(const std::string& path) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.luac", (unsigned long long)fnv1a(path));
+    return cacheDir + "/" + name;
+  }
+
+  static std::string indexPath() {
+    return cacheDir + "/modules.idx";
+  }
+
+  // header: magic, format version, backend, source path, mtime, size
+  static std::string makeHeader(const std::string& path, const SourceInfo& info) {
+    std::string header(MAGIC, sizeof(MAGIC));
+    header.append((const char*)&FORMAT_VERSION, sizeof(FORMAT_VERSION));
+    header.append(Runtime::backendName());
+    header.push_back('\0');
+    header.append(path);
+    header.push_back('\0');
+    header.append((const char*)&info.mtime, sizeof(info.mtime));
+    header.append((const char*)&info.size, sizeof(info.size));
+    return header;
+  }
+
+  static int writer(lua_State* L, const void* p, size_t sz, void* ud) {
+    static_cast<std::string*>(ud)->append((const char*)p, sz);
+    return 0;
+  }
+
+  static void storeCache(lua_State* L, const std::string& path, const std::string& header) {
+    std::string bytecode;
+    if (dumpFunction(L, writer, &bytecode) != 0) return;
+
+    std::error_code ec;
+    fs::create_directories(cacheDir, ec);
+
+    // written next to the target and renamed so a crash never leaves half a chunk
+    std::string target = cachePathFor(path);
+    std::string tmp = target + ".tmp";
+    {
+      std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+      if (!out) return;
+      out.write(header.data(), header.size());
+      out.write(bytecode.data(), bytecode.size());
+      if (!out) return;
+    }
+    fs::rename(tmp, target, ec);
+  }
+
+  int loadFile(lua_State* L, const std::string& path) {
+    if (std::find(loaded.begin(), loaded.end(), path) == loaded.end()) {
+      loaded.push_back(path);
+    }
+
+    SourceInfo info;
+    if (!enabled || !statSource(path, info)) {
+      return luaL_loadfile(L, path.c_str());
+    }
+
+    std::string header = makeHeader(path, info);
+    std::string chunkName = "@" + path;
+
+    std::ifstream in(cachePathFor(path), std::ios::binary);
+    if (in) {
+      std::stringstream buf;
+      buf << in.rdbuf();
+      std::string data = buf.str();
+
+      if (data.size() > header.size() && data.compare(0, header.size(), header) == 0) {
+        int status = luaL_loadbuffer(L, data.data() + header.size(), data.size() - header.size(), chunkName.c_str());
+        if (status == LUA_OK) return status;
+        // stale or foreign bytecode, fall back to the source
+        lua_pop(L, 1);
+      }
+    }
+
+    int status = luaL_loadfile(L, path.c_str());
+    if (status == LUA_OK) {
+      storeCache(L, path, header);
+    }
+    return status;
+  }
+
+  int doFile(lua_State* L, const std::string& path) {
+    int status = loadFile(L, path);
+    if (status != LUA_OK) return status;
+    return lua_pcall(L, 0, LUA_MULTRET, 0);
+  }
+
+  static const char* INDEX_PATH_KEY = "package.path";
+
+  // the first line holds the package.path the entries were resolved against
+  static void loadIndex() {
+    std::ifstream in(indexPath());
+    std::string line;
+    std::string key = std::string(INDEX_PATH_KEY) + '\t';
+    if (!std::getline(in, line) || line.compare(0, key.size(), key) != 0) return;
+    indexedPath = line.substr(key.size());
+
+    while (std::getline(in, line)) {
+      size_t tab = line.find('\t');
+      if (tab == std::string::npos) continue;
+      moduleIndex[line.substr(0, tab)] = line.substr(tab + 1);
+    }
+  }
+
+  // a different package.path can resolve any name to another file, the
+  // index starts over for it
+  static void resetIndex(const std::string& paths) {
+    moduleIndex.clear();
+    indexedPath = paths;
+
+    std::error_code ec;
+    fs::create_directories(cacheDir, ec);
+    std::ofstream out(indexPath(), std::ios::trunc);
+    out << INDEX_PATH_KEY << '\t' << paths << '\n';
+  }
+
+  static void appendIndex(const std::string& name, const std::string& path) {
+    std::error_code ec;
+    fs::create_directories(cacheDir, ec);
+    std::ofstream out(indexPath(), std::ios::app);
+    out << name << '\t' << path << '\n';
+  }
+
+  static std::string packagePath(lua_State* L) {
+    lua_getglobal(L, "package");
+    lua_getfield(L, -1, "path");
+    std::string paths = lua_isstring(L, -1) ? lua_tostring(L, -1) : "";
+    lua_pop(L, 2);
+    return paths;
+  }
+
+  // walks package.path the same way package.searchpath does
+  static bool probe(const std::string& paths, const std::string& name, std::string& found) {
+    std::string file = name;
+    for (char& c : file) {
+      if (c == '.') c = '/';
+    }
+
+    std::stringstream ss(paths);
+    std::string pattern;
+    while (std::getline(ss, pattern, ';')) {
+      if (pattern.empty()) continue;
+
+      std::string candidate;
+      for (char c : pattern) {
+        if (c == '?') candidate += file;
+        else candidate += c;
+      }
+
+      std::error_code ec;
+      if (fs::is_regular_file(candidate, ec)) {
+        found = candidate;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // resolves and loads without raising, so no lua error unwinds past the strings
+  static int search(lua_State* L, const std::string& name, bool& failed) {
+    std::string path;
+    std::string paths = packagePath(L);
+    if (paths != indexedPath) resetIndex(paths);
+
+    auto it = moduleIndex.find(name);
+    std::error_code ec;
+    if (it != moduleIndex.end() && fs::is_regular_file(it->second, ec)) {
+      path = it->second;
+    } else {
+      if (!probe(paths, name, path)) {
+        lua_pushfstring(L, "\n\tno module '%s' in package.path", name.c_str());
+        return 1;
+      }
+      moduleIndex[name] = path;
+      appendIndex(name, path);
+    }
+
+    if (loadFile(L, path) != LUA_OK) {
+      lua_pushfstring(L, "error loading module '%s' from file '%s':\n\t%s",
+                      name.c_str(), path.c_str(), lua_tostring(L, -1));
+      failed = true;
+      return 1;
+    }
+    lua_pushstring(L, path.c_str());
+    return 2;
+  }
+
+  static int searcher(lua_State* L) {
+    const char* name = luaL_checkstring(L, 1);
+    bool failed = false;
+    int results = search(L, name, failed);
+    if (failed) return lua_error(L);
+    return results;
+  }
+
+  std::string cacheDirectory() {
+    const char* noCache = std::getenv("VULPIS_NO_CACHE");
+    if (noCache && std::strcmp(noCache, "1") == 0) return "";
+
+    const char* dir = std::getenv("VULPIS_CACHE_DIR");
+    return dir ? dir : ".vulpis-cache";
+  }
+
+  const std::vector<std::string>& sources() {
+    return loaded;
+  }
+
+  void install(lua_State* L) {
+    cacheDir = cacheDirectory();
+    enabled = !cacheDir.empty();
+    if (!enabled) return;
+    moduleIndex.clear();
+    indexedPath.clear();
+    loadIndex();
+
+    // searchers[1] is the preload searcher, ours goes right after it
+    lua_getglobal(L, "package");
+#if LUA_VERSION_NUM >= 502
+    lua_getfield(L, -1, "searchers");
+#else
+    lua_getfield(L, -1, "loaders");
+#endif
+    int searchers = lua_gettop(L);
+    int count = (int)lua_rawlen(L, searchers);
+
+    for (int i = count; i >= 2; i--) {
+      lua_rawgeti(L, searchers, i);
+      lua_rawseti(L, searchers, i + 1);
+    }
+    lua_pushcfunction(L, searcher);
+    lua_rawseti(L, searchers, 2);
+
+    lua_pop(L, 2);
+  }
+}
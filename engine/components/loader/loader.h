@@ -0,0 +1,24 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "../../lua.hpp"
+
+namespace Loader {
+  // adds a searcher in front of the default lua file searcher that resolves
+  // modules through a remembered name -> path index and loads them from the
+  // bytecode cache. VULPIS_CACHE_DIR overrides the cache directory and
+  // VULPIS_NO_CACHE=1 turns caching off
+  void install(lua_State* L);
+
+  // luaL_loadfile through the bytecode cache, the chunk is left on the stack
+  int loadFile(lua_State* L, const std::string& path);
+
+  // luaL_dofile through the bytecode cache
+  int doFile(lua_State* L, const std::string& path);
+
+  // directory cached artifacts go to, empty when VULPIS_NO_CACHE=1
+  std::string cacheDirectory();
+
+  // every source file loaded so far, app.lua first
+  const std::vector<std::string>& sources();
+}
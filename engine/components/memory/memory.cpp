@@ -0,0 +1,119 @@
+#include "memory.h"
+#include <cstdlib>
+#include <iostream>
+#include <unordered_set>
+#include <vector>
+#include "../decor/decor.h"
+#include "../gc/gc.h"
+#include "../state/state.h"
+#include "../stats/stats.h"
+
+namespace Memory {
+  static std::unordered_set<int> liveRefs;
+  static std::vector<int> released;
+  static std::unordered_set<int> reported;
+  static Node* trackedRoot = nullptr;
+  static double nextLogMs = 0;
+
+  int retain(lua_State* L) {
+    int ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    liveRefs.insert(ref);
+    return ref;
+  }
+
+  void release(lua_State* L, int& ref) {
+    if (ref == -2) return;
+    liveRefs.erase(ref);
+    luaL_unref(L, LUA_REGISTRYINDEX, ref);
+    ref = -2;
+  }
+
+  void release(int& ref) {
+    if (ref == -2) return;
+    liveRefs.erase(ref);
+    released.push_back(ref);
+    ref = -2;
+  }
+
+  void flush(lua_State* L) {
+    for (int ref : released) {
+      luaL_unref(L, LUA_REGISTRYINDEX, ref);
+    }
+    released.clear();
+  }
+
+  size_t refCount() {
+    return liveRefs.size();
+  }
+
+  void track(Node* root) {
+    trackedRoot = root;
+  }
+
+  static size_t nodeBytes(Node* root) {
+    size_t bytes = 0;
+    walkTree(root, [&bytes](Node* n) {
+      bytes += sizeof(Node);
+      bytes += n->children.capacity() * sizeof(Node*);
+      bytes += n->transitions.capacity() * sizeof(TransitionSpec);
+      bytes += n->type.capacity() + n->key.capacity();
+      bytes += Decor::bytes(n);
+      return true;
+    });
+    return bytes;
+  }
+
+  void sample(lua_State* L) {
+    EngineStats& stats = EngineStats::instance();
+    StateManager& state = StateManager::instance();
+
+    stats.liveNodes = Node::liveCount;
+    stats.nodeBytes = trackedRoot ? nodeBytes(trackedRoot) : 0;
+    stats.callbackRefs = liveRefs.size();
+    stats.stateEntries = state.size();
+    stats.stateBytes = state.bytes();
+    stats.luaHeapBytes = GC::heapBytes(L);
+  }
+
+  static void collectOwned(Node* root, std::unordered_set<int>& owned) {
+    walkTree(root, [&owned](Node* n) {
+      for (int ref : {n->onClickRef, n->onHoverRef, n->onPointerMoveRef, n->onWheelRef}) {
+        if (ref != -2) owned.insert(ref);
+      }
+      return true;
+    });
+  }
+
+  void checkRefs() {
+    static const bool enabled = std::getenv("VULPIS_DEBUG_REFS") != nullptr;
+    if (!enabled || !trackedRoot) return;
+
+    std::unordered_set<int> owned;
+    collectOwned(trackedRoot, owned);
+
+    for (int ref : liveRefs) {
+      if (owned.count(ref) || reported.count(ref)) continue;
+      reported.insert(ref);
+      std::cerr << "Memory: registry ref " << ref << " is not owned by any live node" << std::endl;
+    }
+  }
+
+  void tick(lua_State* L, double now) {
+    static const char* interval = std::getenv("VULPIS_MEMORY_LOG");
+    if (!interval) return;
+    if (now < nextLogMs) return;
+
+    double seconds = std::atof(interval);
+    if (seconds <= 0) seconds = 5;
+    nextLogMs = now + seconds * 1000.0;
+
+    sample(L);
+    EngineStats& s = EngineStats::instance();
+    std::cout << "memory: nodes " << s.liveNodes << " (" << s.nodeBytes / 1024 << " KB)"
+      << " | yoga " << s.yogaNodes
+      << " | lua " << s.luaHeapBytes / 1024 << " KB"
+      << " | refs " << s.callbackRefs
+      << " | state " << s.stateEntries << " (" << s.stateBytes << " B)"
+      << " | textures " << s.textureBytes / 1024 << " KB" << std::endl;
+  }
+}
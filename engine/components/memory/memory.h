@@ -0,0 +1,29 @@
+#pragma once
+#include "../ui/ui.h"
+#include "../../lua.hpp"
+
+namespace Memory {
+  // callback refs held by nodes, counted so leaks show up in vulpis.stats()
+
+  // refs the function on top of the stack and pops it
+  int retain(lua_State* L);
+  // unrefs right away and resets ref to -2
+  void release(lua_State* L, int& ref);
+  // for callers without a lua state (freeTree), the unref happens on the next flush
+  void release(int& ref);
+  void flush(lua_State* L);
+  // refs currently retained
+  size_t refCount();
+
+  // root of the live tree, walked for node bytes and by the ref check
+  void track(Node* root);
+
+  // refreshes the memory counters in EngineStats
+  void sample(lua_State* L);
+
+  // VULPIS_DEBUG_REFS, reports callback refs no live node owns
+  void checkRefs();
+
+  // VULPIS_MEMORY_LOG=<seconds>, prints a memory line at that interval
+  void tick(lua_State* L, double now);
+}
@@ -0,0 +1,276 @@
+#include "native.h"
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+#include "../arena/arena.h"
+#include "../color/color.h"
+#include "../style/style.h"
+#include "../refs/refs.h"
+
+namespace Native {
+
+  // a handle is the slot number + 1 in the low bits and the slot's
+  // generation in the high bits. The generation moves on whenever a slot is
+  // emptied, so a handle kept in an old or memoized element table never
+  // reaches the node that reuses its slot
+  static const uint32_t SLOT_BITS = 20;
+  static const uint32_t SLOT_MASK = (1u << SLOT_BITS) - 1;
+
+  struct Slot {
+    Node* node;
+    uint32_t generation;
+  };
+
+  static std::vector<Slot> slots;
+  static std::vector<uint32_t> freeSlots;
+
+  static Slot* slotOf(uint32_t h) {
+    uint32_t index = h & SLOT_MASK;
+    if (index == 0 || index > slots.size()) return nullptr;
+    Slot& slot = slots[index - 1];
+    if (!slot.node || slot.generation != h >> SLOT_BITS) return nullptr;
+    return &slot;
+  }
+
+  static Node* get(uint32_t h) {
+    Slot* slot = slotOf(h);
+    return slot ? slot->node : nullptr;
+  }
+
+  static void empty(uint32_t index) {
+    Slot& slot = slots[index];
+    slot.node = nullptr;
+    slot.generation = (slot.generation + 1) & (UINT32_MAX >> SLOT_BITS);
+    freeSlots.push_back(index);
+  }
+
+  static Node* take(uint32_t h) {
+    Slot* slot = slotOf(h);
+    if (!slot) return nullptr;
+    Node* n = slot->node;
+    empty((uint32_t)(slot - slots.data()));
+    return n;
+  }
+
+  uint32_t handleAt(lua_State* L, int idx) {
+    lua_getfield(L, idx, "native");
+    uint32_t h = lua_isnumber(L, -1) ? (uint32_t)lua_tointeger(L, -1) : 0;
+    lua_pop(L, 1);
+    return h;
+  }
+
+  Node* adopt(uint32_t handle) {
+    return take(handle);
+  }
+
+  // pairs of reused nodes and the shells carrying their new state
+  static std::vector<std::pair<Node*, Node*>> patchWork;
+
+  static void patchLevel(Node* current, Node* incoming) {
+    Style::Invalidation inv = Style::copy(current, incoming);
+
+    // a node reused by index takes over the element's type and key
+    if (current->type != incoming->type) {
+      current->type = incoming->type;
+      inv = Style::Invalidation::Layout;
+    }
+    Refs::setKey(current, incoming->key);
+
+    // a hidden subtree is left as it is until it is shown again
+    if (current->displayNone) {
+      for (Node* c : incoming->children) freeTree(c);
+      incoming->children.clear();
+      Refs::remove(incoming);
+      delete incoming;
+      Style::invalidate(current, inv);
+      return;
+    }
+
+    // children are matched the same way VDOM::reconcile does it
+    Arena::Scope scratch;
+    size_t oldCount = current->children.size();
+    bool* reused = Arena::array<bool>(oldCount);
+    std::fill(reused, reused + oldCount, false);
+    Node** newChildren = Arena::array<Node*>(incoming->children.size());
+
+    for (size_t i = 0; i < incoming->children.size(); i++) {
+      Node* in = incoming->children[i];
+      Node* matched = nullptr;
+
+      if (!in->key.empty()) {
+        for (size_t j = 0; j < current->children.size(); j++) {
+          if (!reused[j] && current->children[j]->key == in->key) {
+            matched = current->children[j];
+            reused[j] = true;
+            break;
+          }
+        }
+      }
+
+      if (!matched && i < current->children.size() && !reused[i] && current->children[i]->key.empty()) {
+        matched = current->children[i];
+        reused[i] = true;
+      }
+
+      if (matched) {
+        patchWork.push_back({matched, in});
+      } else {
+        matched = in;
+        matched->parent = current;
+        matched->makeLayoutDirty();
+      }
+      newChildren[i] = matched;
+    }
+
+    for (size_t i = 0; i < current->children.size(); i++) {
+      if (!reused[i]) {
+        freeTree(current->children[i]);
+        inv = Style::Invalidation::Layout;
+      }
+    }
+
+    // inserts, removals and reorders all move siblings around, same as VDOM's closeFrame
+    size_t newCount = incoming->children.size();
+    if (!std::equal(newChildren, newChildren + newCount, current->children.begin(), current->children.end())) {
+      inv = Style::Invalidation::Layout;
+      current->children.assign(newChildren, newChildren + newCount);
+    }
+
+    // children that were moved over or patched are no longer owned by the shell
+    incoming->children.clear();
+    Refs::remove(incoming);
+    delete incoming;
+
+    Style::invalidate(current, inv);
+  }
+
+  // reused children are queued instead of recursed into so any depth is safe
+  void patch(Node* current, Node* incoming) {
+    size_t base = patchWork.size();
+    patchWork.push_back({current, incoming});
+
+    while (patchWork.size() > base) {
+      std::pair<Node*, Node*> next = patchWork.back();
+      patchWork.pop_back();
+      patchLevel(next.first, next.second);
+    }
+  }
+
+  // slots and their generations are kept, handles from earlier frames stay dead
+  void releasePending() {
+    for (uint32_t i = 0; i < slots.size(); i++) {
+      if (!slots[i].node) continue;
+      freeTree(slots[i].node);
+      empty(i);
+    }
+  }
+}
+
+using namespace Native;
+
+extern "C" {
+
+  uint32_t vulpis_node_new(const char* type, const char* key) {
+    Node* n = new Node();
+    if (type) n->type = type;
+    if (key) Refs::setKey(n, key);
+
+    uint32_t index;
+    if (!freeSlots.empty()) {
+      index = freeSlots.back();
+      freeSlots.pop_back();
+    } else if (slots.size() < SLOT_MASK) {
+      index = (uint32_t)slots.size();
+      slots.push_back({nullptr, 0});
+    } else {
+      std::cerr << "Native Error: more than " << SLOT_MASK << " nodes pending in one frame" << std::endl;
+      freeTree(n);
+      return 0;
+    }
+
+    slots[index].node = n;
+    return (slots[index].generation << SLOT_BITS) | (index + 1);
+  }
+
+  void vulpis_node_set_size(uint32_t h, float w, int wPercent, float hgt, int hPercent) {
+    Node* n = get(h);
+    if (!n) return;
+    n->widthStyle = wPercent ? Length::Percent(w) : Length(w);
+    n->heightStyle = hPercent ? Length::Percent(hgt) : Length(hgt);
+  }
+
+  void vulpis_node_set_limits(uint32_t h, float minW, float maxW, float minH, float maxH) {
+    Node* n = get(h);
+    if (!n) return;
+    n->minWidth = minW;
+    n->maxWidth = maxW;
+    n->minHeight = minH;
+    n->maxHeight = maxH;
+  }
+
+  void vulpis_node_set_padding(uint32_t h, int top, int right, int bottom, int left) {
+    Node* n = get(h);
+    if (!n) return;
+    n->paddingTop = top;
+    n->paddingRight = right;
+    n->paddingBottom = bottom;
+    n->paddingLeft = left;
+    n->padding = (top == right && right == bottom && bottom == left) ? top : 0;
+  }
+
+  void vulpis_node_set_margin(uint32_t h, int top, int right, int bottom, int left) {
+    Node* n = get(h);
+    if (!n) return;
+    n->marginTop = top;
+    n->marginRight = right;
+    n->marginBottom = bottom;
+    n->marginLeft = left;
+    n->margin = (top == right && right == bottom && bottom == left) ? top : 0;
+  }
+
+  void vulpis_node_set_gap(uint32_t h, int gap) {
+    Node* n = get(h);
+    if (n) n->spacing = gap;
+  }
+
+  void vulpis_node_set_flex(uint32_t h, float grow, const char* alignItems, const char* justifyContent) {
+    Node* n = get(h);
+    if (!n) return;
+    n->flexGrow = grow;
+    n->alignItems = parseAlign(alignItems ? alignItems : "start");
+    n->justifyContent = parseJustify(justifyContent ? justifyContent : "start");
+  }
+
+  void vulpis_node_set_color(uint32_t h, uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
+    Node* n = get(h);
+    if (!n) return;
+    n->color = {r, g, b, a};
+    n->hasBackground = true;
+  }
+
+  void vulpis_node_set_color_hex(uint32_t h, const char* hex) {
+    Node* n = get(h);
+    if (!n) return;
+    n->color = parseColor(hex);
+    n->hasBackground = true;
+  }
+
+  void vulpis_node_set_display(uint32_t h, int none) {
+    Node* n = get(h);
+    if (n) n->displayNone = none != 0;
+  }
+
+  void vulpis_node_append(uint32_t parent, uint32_t child) {
+    Node* p = get(parent);
+    if (!p || !get(child)) return;
+    Node* c = take(child);
+    c->parent = p;
+    p->children.push_back(c);
+  }
+
+  void vulpis_node_free(uint32_t h) {
+    Node* n = take(h);
+    if (n) freeTree(n);
+  }
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <cstdint>
+#include "../ui/ui.h"
+
+// C ABI for building nodes from LuaJIT FFI. Nodes are addressed by handle
+// until they are attached to a parent or adopted by buildNode/patchNode
+// through the `native` field of an element table.
+extern "C" {
+  uint32_t vulpis_node_new(const char* type, const char* key);
+  void vulpis_node_set_size(uint32_t h, float w, int wPercent, float hgt, int hPercent);
+  void vulpis_node_set_limits(uint32_t h, float minW, float maxW, float minH, float maxH);
+  void vulpis_node_set_padding(uint32_t h, int top, int right, int bottom, int left);
+  void vulpis_node_set_margin(uint32_t h, int top, int right, int bottom, int left);
+  void vulpis_node_set_gap(uint32_t h, int gap);
+  void vulpis_node_set_flex(uint32_t h, float grow, const char* alignItems, const char* justifyContent);
+  void vulpis_node_set_color(uint32_t h, uint8_t r, uint8_t g, uint8_t b, uint8_t a);
+  void vulpis_node_set_color_hex(uint32_t h, const char* hex);
+  // display = "none" when none is non-zero
+  void vulpis_node_set_display(uint32_t h, int none);
+  // moves `child` under `parent`, the child handle is consumed
+  void vulpis_node_append(uint32_t parent, uint32_t child);
+  void vulpis_node_free(uint32_t h);
+}
+
+namespace Native {
+  // `native` handle of the element table at idx, 0 if it has none
+  uint32_t handleAt(lua_State* L, int idx);
+
+  // takes ownership of a pending node, nullptr if the handle is not pending
+  Node* adopt(uint32_t handle);
+
+  // patches `current` and its children to match `incoming`, which is consumed
+  void patch(Node* current, Node* incoming);
+
+  // frees nodes created since the last call that never reached the tree
+  void releasePending();
+}
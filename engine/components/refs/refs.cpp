@@ -0,0 +1,146 @@
+#include "refs.h"
+#include <unordered_map>
+#include "../style/style.h"
+
+namespace Refs {
+
+  // the view points into the key of the first node of each chain
+  static std::unordered_map<std::string_view, Node*> index;
+  static size_t count = 0;
+
+  static void link(Node* n) {
+    if (n->key.empty()) return;
+    count++;
+
+    auto [it, inserted] = index.try_emplace(std::string_view(n->key), n);
+    if (inserted) return;
+
+    // later nodes go behind the first so the view in the map stays valid
+    Node* first = it->second;
+    n->keyPrev = first;
+    n->keyNext = first->keyNext;
+    if (first->keyNext) first->keyNext->keyPrev = n;
+    first->keyNext = n;
+  }
+
+  static void unlink(Node* n) {
+    if (n->keyPrev) {
+      n->keyPrev->keyNext = n->keyNext;
+      if (n->keyNext) n->keyNext->keyPrev = n->keyPrev;
+    } else {
+      auto it = n->key.empty() ? index.end() : index.find(n->key);
+      if (it == index.end() || it->second != n) return;
+
+      index.erase(it);
+      if (n->keyNext) {
+        n->keyNext->keyPrev = nullptr;
+        index.emplace(std::string_view(n->keyNext->key), n->keyNext);
+      }
+    }
+
+    n->keyPrev = n->keyNext = nullptr;
+    count--;
+  }
+
+  void setKey(Node* n, std::string_view key) {
+    if (n->key == key) return;
+    unlink(n);
+    n->key.assign(key.data(), key.size());
+    link(n);
+  }
+
+  void remove(Node* n) {
+    unlink(n);
+  }
+
+  Node* find(std::string_view key) {
+    auto it = index.find(key);
+    return it == index.end() ? nullptr : it->second;
+  }
+
+  size_t size() {
+    return count;
+  }
+}
+
+static const char* REF_METATABLE = "vulpis.ref";
+
+// the node behind the ref at idx 1, looked up on every call so a ref
+// outlives any number of re-renders and simply finds nothing once it is gone
+static Node* refNode(lua_State* L) {
+  luaL_checktype(L, 1, LUA_TTABLE);
+  lua_getfield(L, 1, "key");
+  size_t len = 0;
+  const char* key = lua_tolstring(L, -1, &len);
+  Node* n = key ? Refs::find(std::string_view(key, len)) : nullptr;
+  lua_pop(L, 1);
+  return n;
+}
+
+// ref:setStyle(style) patches only the keys present in style and dirties the
+// node's layout or paint, false when no live node has the key
+int l_refSetStyle(lua_State* L) {
+  luaL_checktype(L, 2, LUA_TTABLE);
+  Node* n = refNode(L);
+  if (!n) {
+    lua_pushboolean(L, 0);
+    return 1;
+  }
+
+  Style::invalidate(n, Style::patch(L, n, 2));
+  lua_pushboolean(L, 1);
+  return 1;
+}
+
+// ref:getLayout() gives { x, y, w, h } from the last solve, nil without a node
+int l_refGetLayout(lua_State* L) {
+  Node* n = refNode(L);
+  if (!n) {
+    lua_pushnil(L);
+    return 1;
+  }
+
+  lua_createtable(L, 0, 4);
+  lua_pushnumber(L, n->x);
+  lua_setfield(L, -2, "x");
+  lua_pushnumber(L, n->y);
+  lua_setfield(L, -2, "y");
+  lua_pushnumber(L, n->w);
+  lua_setfield(L, -2, "w");
+  lua_pushnumber(L, n->h);
+  lua_setfield(L, -2, "h");
+  return 1;
+}
+
+int l_refExists(lua_State* L) {
+  lua_pushboolean(L, refNode(L) != nullptr);
+  return 1;
+}
+
+int l_ref(lua_State* L) {
+  luaL_checkstring(L, 1);
+  lua_createtable(L, 0, 1);
+  lua_pushvalue(L, 1);
+  lua_setfield(L, -2, "key");
+  luaL_getmetatable(L, REF_METATABLE);
+  lua_setmetatable(L, -2);
+  return 1;
+}
+
+void registerRefBindings(lua_State* L) {
+  luaL_newmetatable(L, REF_METATABLE);
+  lua_newtable(L);
+  lua_pushcfunction(L, l_refSetStyle);
+  lua_setfield(L, -2, "setStyle");
+  lua_pushcfunction(L, l_refGetLayout);
+  lua_setfield(L, -2, "getLayout");
+  lua_pushcfunction(L, l_refExists);
+  lua_setfield(L, -2, "exists");
+  lua_setfield(L, -2, "__index");
+  lua_pop(L, 1);
+
+  pushVulpisTable(L);
+  lua_pushcfunction(L, l_ref);
+  lua_setfield(L, -2, "ref");
+  lua_pop(L, 1);
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include <string_view>
+#include "../ui/ui.h"
+
+// index from key to live node. Keys only have to be unique among siblings
+// for reconcile, nodes sharing a key are chained and find returns the one
+// indexed first
+namespace Refs {
+  // changes the key of n and moves it in the index
+  void setKey(Node* n, std::string_view key);
+
+  // n is being freed
+  void remove(Node* n);
+
+  Node* find(std::string_view key);
+
+  // nodes currently in the index
+  size_t size();
+}
+
+// registers vulpis.ref(key), a handle whose setStyle and getLayout act on
+// the live node with that key without a re-render
+void registerRefBindings(lua_State* L);
@@ -0,0 +1,94 @@
+#include "render.h"
+#include <iostream>
+#include "../layers/layers.h"
+
+namespace Render {
+
+  void SdlBackend::begin(int w, int h, SDL_Color color) {
+    SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, color.a);
+    SDL_RenderClear(renderer);
+  }
+
+  void SdlBackend::present() {
+    SDL_RenderPresent(renderer);
+  }
+
+  SDL_Rect SdlBackend::clip() {
+    SDL_Rect rect;
+    if (SDL_RenderIsClipEnabled(renderer)) {
+      SDL_RenderGetClipRect(renderer, &rect);
+    } else {
+      SDL_RenderGetViewport(renderer, &rect);
+    }
+    return rect;
+  }
+
+  void SdlBackend::setClip(const SDL_Rect& rect) {
+    SDL_RenderSetClipRect(renderer, &rect);
+  }
+
+  void SdlBackend::fillRect(const SDL_Rect& rect, SDL_Color color) {
+    SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, color.a);
+    SDL_RenderFillRect(renderer, &rect);
+  }
+
+  void SdlBackend::fillGeometry(const SDL_Vertex* vertices, int vertexCount, const int* indices, int indexCount) {
+    SDL_RenderGeometry(renderer, nullptr, vertices, vertexCount, indices, indexCount);
+  }
+
+  bool SdlBackend::drawLayer(Node* n, const SDL_Rect& box) {
+    SDL_Rect current = clip();
+    if (!Layers::prepare(renderer, n)) return false;
+
+    // filling the texture may have switched render targets, which drops the clip
+    SDL_RenderSetClipRect(renderer, &current);
+    SDL_RenderCopy(renderer, n->layerTexture, nullptr, &box);
+    return true;
+  }
+
+  bool SdlBackend::readPixels(std::vector<uint32_t>& pixels, int& w, int& h) {
+    if (SDL_GetRendererOutputSize(renderer, &w, &h) != 0) return false;
+    pixels.resize((size_t)w * h);
+    return SDL_RenderReadPixels(renderer, nullptr, SDL_PIXELFORMAT_ARGB8888, pixels.data(), w * 4) == 0;
+  }
+
+  RenderBackend* createBackend(const std::string& name, SDL_Renderer* renderer) {
+    if (name == "sdl") return new SdlBackend(renderer);
+    if (name == "software") return createSoftwareBackend(renderer);
+    return nullptr;
+  }
+
+  std::string readBackend(lua_State* L, int idx) {
+    std::string name = "sdl";
+
+    lua_getfield(L, idx, "renderer");
+    if (lua_isstring(L, -1)) {
+      name = lua_tostring(L, -1);
+    } else if (!lua_isnil(L, -1)) {
+      std::cerr << "Render Error: Window().renderer must be \"sdl\" or \"software\"" << std::endl;
+    }
+    lua_pop(L, 1);
+
+    return name;
+  }
+
+  bool saveScreenshot(RenderBackend& backend, const std::string& path) {
+    std::vector<uint32_t> pixels;
+    int w = 0, h = 0;
+    if (!backend.readPixels(pixels, w, h)) {
+      std::cerr << "Render Error: could not read the frame back: " << SDL_GetError() << std::endl;
+      return false;
+    }
+
+    SDL_Surface* surface = SDL_CreateRGBSurfaceWithFormatFrom(
+      pixels.data(), w, h, 32, w * 4, SDL_PIXELFORMAT_ARGB8888);
+    if (!surface) return false;
+
+    bool saved = SDL_SaveBMP(surface, path.c_str()) == 0;
+    if (!saved) {
+      std::cerr << "Render Error: could not write " << path << ": " << SDL_GetError() << std::endl;
+    }
+    SDL_FreeSurface(surface);
+    return saved;
+  }
+}
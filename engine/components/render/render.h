@@ -0,0 +1,69 @@
+#pragma once
+#include <SDL2/SDL.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "../ui/ui.h"
+#include "../../lua.hpp"
+
+namespace Render {
+
+  // what renderNode draws through, coordinates are window pixels
+  class RenderBackend {
+    public:
+      virtual ~RenderBackend() = default;
+
+      // starts a frame the size of the window, cleared to color
+      virtual void begin(int w, int h, SDL_Color color) = 0;
+      // shows the frame
+      virtual void present() = 0;
+
+      // current clip, the whole target when nothing is clipped
+      virtual SDL_Rect clip() = 0;
+      virtual void setClip(const SDL_Rect& rect) = 0;
+
+      // alpha blended fill, cut to the clip
+      virtual void fillRect(const SDL_Rect& rect, SDL_Color color) = 0;
+
+      // colored triangles, three indices each, cut to the clip
+      virtual void fillGeometry(const SDL_Vertex* vertices, int vertexCount, const int* indices, int indexCount) = 0;
+
+      // draws n's subtree from a cached layer, false when the backend has
+      // no layers and the subtree should be drawn directly
+      virtual bool drawLayer(Node* n, const SDL_Rect& box) { return false; }
+
+      // the frame drawn so far as ARGB8888 rows
+      virtual bool readPixels(std::vector<uint32_t>& pixels, int& w, int& h) = 0;
+  };
+
+  // draws straight through the SDL renderer, layers become render targets
+  class SdlBackend : public RenderBackend {
+    public:
+      explicit SdlBackend(SDL_Renderer* renderer) : renderer(renderer) {}
+
+      void begin(int w, int h, SDL_Color color) override;
+      void present() override;
+      SDL_Rect clip() override;
+      void setClip(const SDL_Rect& rect) override;
+      void fillRect(const SDL_Rect& rect, SDL_Color color) override;
+      void fillGeometry(const SDL_Vertex* vertices, int vertexCount, const int* indices, int indexCount) override;
+      bool drawLayer(Node* n, const SDL_Rect& box) override;
+      bool readPixels(std::vector<uint32_t>& pixels, int& w, int& h) override;
+
+    private:
+      SDL_Renderer* renderer;
+  };
+
+  // rasterizes into a cpu framebuffer with simd blend kernels and uploads it
+  // with one texture update per frame. Same pixels on every machine
+  RenderBackend* createSoftwareBackend(SDL_Renderer* renderer);
+
+  // "sdl" or "software", nullptr for an unknown name
+  RenderBackend* createBackend(const std::string& name, SDL_Renderer* renderer);
+
+  // Window().renderer of the config table at idx, "sdl" when it is not set
+  std::string readBackend(lua_State* L, int idx);
+
+  // writes the current frame as a bmp
+  bool saveScreenshot(RenderBackend& backend, const std::string& path);
+}
@@ -0,0 +1,251 @@
+#include "render.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX2__)
+#define VULPIS_BLEND_AVX2 1
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VULPIS_BLEND_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace Render {
+
+  // ARGB8888, little endian so the bytes of a pixel are b, g, r, a
+  static uint32_t pack(SDL_Color c) {
+    return ((uint32_t)c.a << 24) | ((uint32_t)c.r << 16) | ((uint32_t)c.g << 8) | c.b;
+  }
+
+  // every channel is (src * a + dst * (255 - a)) / 255 rounded, with the
+  // source alpha channel taken as 255. The simd paths use the exact same
+  // integer math, so the pixels do not depend on which one ran
+  static inline uint32_t blendScalar(uint32_t dst, const uint16_t src[4], uint16_t inv) {
+    uint32_t out = 0;
+    for (int i = 0; i < 4; i++) {
+      uint32_t t = src[i] + ((dst >> (i * 8)) & 0xFF) * inv;
+      out |= ((t + (t >> 8)) >> 8) << (i * 8);
+    }
+    return out;
+  }
+
+  static void blendSpan(uint32_t* row, int count, SDL_Color color) {
+    if (color.a == 255) {
+      std::fill_n(row, count, pack(color));
+      return;
+    }
+    if (color.a == 0) return;
+
+    uint16_t a = color.a;
+    uint16_t inv = 255 - a;
+    // premultiplied source plus the rounding bias, in b, g, r, a order
+    uint16_t src[4] = {
+      (uint16_t)(color.b * a + 128),
+      (uint16_t)(color.g * a + 128),
+      (uint16_t)(color.r * a + 128),
+      (uint16_t)(255 * a + 128),
+    };
+
+    int i = 0;
+
+#if defined(VULPIS_BLEND_AVX2)
+    __m256i zero = _mm256_setzero_si256();
+    __m256i srcv = _mm256_setr_epi16(src[0], src[1], src[2], src[3], src[0], src[1], src[2], src[3],
+                                     src[0], src[1], src[2], src[3], src[0], src[1], src[2], src[3]);
+    __m256i invv = _mm256_set1_epi16((short)inv);
+    for (; i + 8 <= count; i += 8) {
+      __m256i px = _mm256_loadu_si256((const __m256i*)(row + i));
+      __m256i lo = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(px, zero), invv), srcv);
+      __m256i hi = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(px, zero), invv), srcv);
+      lo = _mm256_srli_epi16(_mm256_add_epi16(lo, _mm256_srli_epi16(lo, 8)), 8);
+      hi = _mm256_srli_epi16(_mm256_add_epi16(hi, _mm256_srli_epi16(hi, 8)), 8);
+      _mm256_storeu_si256((__m256i*)(row + i), _mm256_packus_epi16(lo, hi));
+    }
+#elif defined(VULPIS_BLEND_SSE2)
+    __m128i zero = _mm_setzero_si128();
+    __m128i srcv = _mm_setr_epi16(src[0], src[1], src[2], src[3], src[0], src[1], src[2], src[3]);
+    __m128i invv = _mm_set1_epi16((short)inv);
+    for (; i + 4 <= count; i += 4) {
+      __m128i px = _mm_loadu_si128((const __m128i*)(row + i));
+      __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(px, zero), invv), srcv);
+      __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(px, zero), invv), srcv);
+      lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+      hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+      _mm_storeu_si128((__m128i*)(row + i), _mm_packus_epi16(lo, hi));
+    }
+#endif
+
+    for (; i < count; i++) {
+      row[i] = blendScalar(row[i], src, inv);
+    }
+  }
+
+  static inline uint32_t blendPixel(uint32_t dst, SDL_Color color) {
+    if (color.a == 255) return pack(color);
+    if (color.a == 0) return dst;
+
+    uint16_t a = color.a;
+    uint16_t src[4] = {
+      (uint16_t)(color.b * a + 128),
+      (uint16_t)(color.g * a + 128),
+      (uint16_t)(color.r * a + 128),
+      (uint16_t)(255 * a + 128),
+    };
+    return blendScalar(dst, src, 255 - a);
+  }
+
+  static bool sameColor(const SDL_Color& a, const SDL_Color& b) {
+    return a.r == b.r && a.g == b.g && a.b == b.b && a.a == b.a;
+  }
+
+  // > 0 when p is left of the edge a -> b
+  static inline float edge(const SDL_FPoint& a, const SDL_FPoint& b, float px, float py) {
+    return (b.x - a.x) * (py - a.y) - (b.y - a.y) * (px - a.x);
+  }
+
+  // top-left fill rule, pixels on an edge shared by two triangles are filled once
+  static inline bool topLeft(const SDL_FPoint& a, const SDL_FPoint& b) {
+    return (a.y == b.y && b.x < a.x) || b.y < a.y;
+  }
+
+  class SoftwareBackend : public RenderBackend {
+    public:
+      explicit SoftwareBackend(SDL_Renderer* renderer) : renderer(renderer) {}
+
+      ~SoftwareBackend() override {
+        if (texture) SDL_DestroyTexture(texture);
+      }
+
+      void begin(int w, int h, SDL_Color color) override {
+        if (w != width || h != height) {
+          width = std::max(w, 1);
+          height = std::max(h, 1);
+          pixels.assign((size_t)width * height, 0);
+          if (texture) SDL_DestroyTexture(texture);
+          texture = nullptr;
+        }
+
+        color.a = 255;
+        std::fill(pixels.begin(), pixels.end(), pack(color));
+        clipRect = {0, 0, width, height};
+      }
+
+      void present() override {
+        if (!texture) {
+          texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, width, height);
+          if (!texture) return;
+        }
+
+        SDL_UpdateTexture(texture, nullptr, pixels.data(), width * 4);
+        SDL_RenderCopy(renderer, texture, nullptr, nullptr);
+        SDL_RenderPresent(renderer);
+      }
+
+      SDL_Rect clip() override {
+        return clipRect;
+      }
+
+      void setClip(const SDL_Rect& rect) override {
+        SDL_Rect bounds = {0, 0, width, height};
+        if (!SDL_IntersectRect(&rect, &bounds, &clipRect)) {
+          clipRect = {0, 0, 0, 0};
+        }
+      }
+
+      void fillRect(const SDL_Rect& rect, SDL_Color color) override {
+        SDL_Rect area;
+        if (!SDL_IntersectRect(&rect, &clipRect, &area)) return;
+
+        for (int y = area.y; y < area.y + area.h; y++) {
+          blendSpan(pixels.data() + (size_t)y * width + area.x, area.w, color);
+        }
+      }
+
+      void fillGeometry(const SDL_Vertex* vertices, int vertexCount, const int* indices, int indexCount) override {
+        for (int i = 0; i + 2 < indexCount; i += 3) {
+          if (indices[i] >= vertexCount || indices[i + 1] >= vertexCount || indices[i + 2] >= vertexCount) continue;
+          fillTriangle(vertices[indices[i]], vertices[indices[i + 1]], vertices[indices[i + 2]]);
+        }
+      }
+
+      bool readPixels(std::vector<uint32_t>& out, int& w, int& h) override {
+        out = pixels;
+        w = width;
+        h = height;
+        return true;
+      }
+
+    private:
+      // samples pixel centers, colors are interpolated across the triangle
+      void fillTriangle(SDL_Vertex v0, SDL_Vertex v1, SDL_Vertex v2) {
+        float area = edge(v0.position, v1.position, v2.position.x, v2.position.y);
+        if (area == 0) return;
+        if (area < 0) {
+          std::swap(v1, v2);
+          area = -area;
+        }
+
+        const SDL_FPoint& p0 = v0.position;
+        const SDL_FPoint& p1 = v1.position;
+        const SDL_FPoint& p2 = v2.position;
+
+        int minX = std::max(clipRect.x, (int)std::floor(std::min({p0.x, p1.x, p2.x})));
+        int maxX = std::min(clipRect.x + clipRect.w - 1, (int)std::ceil(std::max({p0.x, p1.x, p2.x})));
+        int minY = std::max(clipRect.y, (int)std::floor(std::min({p0.y, p1.y, p2.y})));
+        int maxY = std::min(clipRect.y + clipRect.h - 1, (int)std::ceil(std::max({p0.y, p1.y, p2.y})));
+        if (minX > maxX || minY > maxY) return;
+
+        bool tl0 = topLeft(p1, p2), tl1 = topLeft(p2, p0), tl2 = topLeft(p0, p1);
+        bool uniform = sameColor(v0.color, v1.color) && sameColor(v1.color, v2.color);
+
+        for (int y = minY; y <= maxY; y++) {
+          float py = y + 0.5f;
+          uint32_t* row = pixels.data() + (size_t)y * width;
+          int runStart = -1, runEnd = -1;
+
+          for (int x = minX; x <= maxX; x++) {
+            float px = x + 0.5f;
+            float w0 = edge(p1, p2, px, py);
+            float w1 = edge(p2, p0, px, py);
+            float w2 = edge(p0, p1, px, py);
+            bool inside = (w0 > 0 || (w0 == 0 && tl0)) &&
+                          (w1 > 0 || (w1 == 0 && tl1)) &&
+                          (w2 > 0 || (w2 == 0 && tl2));
+            if (!inside) {
+              // a triangle covers one run per row
+              if (runStart >= 0) break;
+              continue;
+            }
+
+            if (runStart < 0) runStart = x;
+            runEnd = x;
+
+            if (!uniform) {
+              float b0 = w0 / area, b1 = w1 / area, b2 = w2 / area;
+              SDL_Color c = {
+                (Uint8)std::lround(v0.color.r * b0 + v1.color.r * b1 + v2.color.r * b2),
+                (Uint8)std::lround(v0.color.g * b0 + v1.color.g * b1 + v2.color.g * b2),
+                (Uint8)std::lround(v0.color.b * b0 + v1.color.b * b1 + v2.color.b * b2),
+                (Uint8)std::lround(v0.color.a * b0 + v1.color.a * b1 + v2.color.a * b2),
+              };
+              row[x] = blendPixel(row[x], c);
+            }
+          }
+
+          if (uniform && runStart >= 0) {
+            blendSpan(row + runStart, runEnd - runStart + 1, v0.color);
+          }
+        }
+      }
+
+      SDL_Renderer* renderer;
+      SDL_Texture* texture = nullptr;
+      std::vector<uint32_t> pixels;
+      int width = 0, height = 0;
+      SDL_Rect clipRect = {0, 0, 0, 0};
+  };
+
+  RenderBackend* createSoftwareBackend(SDL_Renderer* renderer) {
+    return new SoftwareBackend(renderer);
+  }
+}
@@ -0,0 +1,299 @@
+#include "replay.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include "../stats/stats.h"
+
+namespace Replay {
+
+  static const char MAGIC[4] = {'V', 'L', 'R', 'P'};
+  static const uint32_t FORMAT_VERSION = 1;
+
+  // sdl never uses 0 as an event type, so it marks the start of a frame
+  static const uint32_t FRAME_MARKER = 0;
+
+  // file: header, then records in the order they happened
+  struct Header {
+    char magic[4];
+    uint32_t version;
+    int32_t w, h;
+  };
+
+  // a frame marker or an event, timeMs counts from the start of the
+  // recording. a, b and c hold the few fields of the event the engine reads
+  struct Record {
+    uint32_t frame;
+    uint32_t type;
+    uint32_t timeMs;
+    int32_t a, b, c;
+  };
+
+  struct Row {
+    uint32_t frame;
+    uint32_t events;
+    FrameTiming timing;
+  };
+
+  static Options options;
+  static Header header;
+
+  static std::ofstream out;
+  static double recordStartMs = 0;
+  static Uint32 recordStartTicks = 0;
+
+  static std::vector<Record> records;
+  static size_t cursor = 0;
+  static bool based = false;
+  static double baseMs = 0;
+  static uint32_t frameEvents = 0;
+  static std::vector<Row> rows;
+
+  static uint32_t frame = 0;
+
+  bool parseFlag(const std::string& arg, Options& opts) {
+    if (arg.rfind("--record=", 0) == 0) opts.record = arg.substr(9);
+    else if (arg.rfind("--replay=", 0) == 0) opts.replay = arg.substr(9);
+    else if (arg.rfind("--timings=", 0) == 0) opts.timings = arg.substr(10);
+    else if (arg == "--uncapped") opts.uncapped = true;
+    else return false;
+    return true;
+  }
+
+  // user events carry pointers and the rest is nothing the engine reads,
+  // only these survive a round trip through the file
+  static bool pack(const SDL_Event& e, Record& r) {
+    r.a = r.b = r.c = 0;
+    switch (e.type) {
+      case SDL_QUIT:
+        return true;
+      case SDL_WINDOWEVENT:
+        r.a = e.window.event;
+        r.b = e.window.data1;
+        r.c = e.window.data2;
+        return true;
+      case SDL_MOUSEMOTION:
+        r.a = e.motion.x;
+        r.b = e.motion.y;
+        r.c = (int32_t)e.motion.state;
+        return true;
+      case SDL_MOUSEBUTTONDOWN:
+      case SDL_MOUSEBUTTONUP:
+        r.a = e.button.x;
+        r.b = e.button.y;
+        r.c = e.button.button | (e.button.clicks << 8);
+        return true;
+      case SDL_MOUSEWHEEL:
+        r.a = e.wheel.x;
+        r.b = e.wheel.y;
+        r.c = (int32_t)e.wheel.direction;
+        return true;
+      case SDL_KEYDOWN:
+      case SDL_KEYUP:
+        r.a = e.key.keysym.scancode;
+        r.b = e.key.keysym.sym;
+        r.c = e.key.keysym.mod | (e.key.repeat << 16);
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  static void unpack(const Record& r, SDL_Event& e) {
+    SDL_zero(e);
+    e.type = r.type;
+    e.common.timestamp = SDL_GetTicks();
+
+    switch (r.type) {
+      case SDL_WINDOWEVENT:
+        e.window.event = (Uint8)r.a;
+        e.window.data1 = r.b;
+        e.window.data2 = r.c;
+        break;
+      case SDL_MOUSEMOTION:
+        e.motion.x = r.a;
+        e.motion.y = r.b;
+        e.motion.state = (Uint32)r.c;
+        break;
+      case SDL_MOUSEBUTTONDOWN:
+      case SDL_MOUSEBUTTONUP:
+        e.button.x = r.a;
+        e.button.y = r.b;
+        e.button.button = (Uint8)(r.c & 0xff);
+        e.button.clicks = (Uint8)(r.c >> 8);
+        e.button.state = r.type == SDL_MOUSEBUTTONDOWN ? SDL_PRESSED : SDL_RELEASED;
+        break;
+      case SDL_MOUSEWHEEL:
+        e.wheel.x = r.a;
+        e.wheel.y = r.b;
+        e.wheel.direction = (Uint32)r.c;
+        break;
+      case SDL_KEYDOWN:
+      case SDL_KEYUP:
+        e.key.keysym.scancode = (SDL_Scancode)r.a;
+        e.key.keysym.sym = (SDL_Keycode)r.b;
+        e.key.keysym.mod = (Uint16)(r.c & 0xffff);
+        e.key.repeat = (Uint8)(r.c >> 16);
+        e.key.state = r.type == SDL_KEYDOWN ? SDL_PRESSED : SDL_RELEASED;
+        break;
+    }
+  }
+
+  static bool load(const std::string& file) {
+    std::ifstream in(file, std::ios::binary);
+    if (!in.read((char*)&header, sizeof(header)) ||
+        std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+        header.version != FORMAT_VERSION) {
+      std::cerr << "Replay Error: " << file << " is not a recording" << std::endl;
+      return false;
+    }
+
+    Record r;
+    while (in.read((char*)&r, sizeof(r))) {
+      records.push_back(r);
+    }
+    return true;
+  }
+
+  bool start(const Options& opts, int w, int h) {
+    options = opts;
+
+    if (!options.replay.empty()) {
+      options.record.clear();
+      if (!load(options.replay)) {
+        options.replay.clear();
+        return false;
+      }
+      return true;
+    }
+
+    if (!options.record.empty()) {
+      out.open(options.record, std::ios::binary | std::ios::trunc);
+      if (!out) {
+        std::cerr << "Replay Error: can not write " << options.record << std::endl;
+        options.record.clear();
+        return false;
+      }
+
+      std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+      header.version = FORMAT_VERSION;
+      header.w = w;
+      header.h = h;
+      out.write((const char*)&header, sizeof(header));
+
+      recordStartMs = nowMs();
+      recordStartTicks = SDL_GetTicks();
+    }
+    return true;
+  }
+
+  bool recording() {
+    return !options.record.empty();
+  }
+
+  bool replaying() {
+    return !options.replay.empty();
+  }
+
+  void windowSize(int& w, int& h) {
+    if (!replaying() || header.w <= 0 || header.h <= 0) return;
+    w = header.w;
+    h = header.h;
+  }
+
+  bool beginFrame(double now) {
+    if (recording()) {
+      frame++;
+      Record marker = {frame, FRAME_MARKER, (uint32_t)(now - recordStartMs), 0, 0, 0};
+      out.write((const char*)&marker, sizeof(marker));
+      return true;
+    }
+    if (!replaying()) return true;
+
+    // events of the last frame nobody asked for are dropped with it
+    while (cursor < records.size() && records[cursor].type != FRAME_MARKER) cursor++;
+    if (cursor == records.size()) return false;
+
+    const Record& marker = records[cursor++];
+    frame = marker.frame;
+    frameEvents = 0;
+
+    if (!based) {
+      baseMs = now - marker.timeMs;
+      based = true;
+    }
+
+    double at = baseMs + marker.timeMs;
+    if (!options.uncapped) {
+      double wait = at - nowMs();
+      if (wait >= 1) SDL_Delay((Uint32)wait);
+    }
+    pinnedClockMs() = at;
+    return true;
+  }
+
+  void record(const SDL_Event& event) {
+    if (!recording()) return;
+
+    Record r;
+    if (!pack(event, r)) return;
+    r.frame = frame;
+    r.type = event.type;
+    // events queued before the recording started count as its first moment
+    r.timeMs = event.common.timestamp > recordStartTicks ? event.common.timestamp - recordStartTicks : 0;
+    out.write((const char*)&r, sizeof(r));
+  }
+
+  bool next(SDL_Event& event) {
+    if (!replaying() || cursor >= records.size() || records[cursor].type == FRAME_MARKER) {
+      return false;
+    }
+    unpack(records[cursor++], event);
+    frameEvents++;
+    return true;
+  }
+
+  void endFrame(const FrameTiming& timing) {
+    if (!replaying()) return;
+    rows.push_back({frame, frameEvents, timing});
+  }
+
+  static void writeTimings() {
+    std::string file = options.timings.empty() ? options.replay + ".timings.csv" : options.timings;
+    std::ofstream csv(file, std::ios::trunc);
+    csv << "frame,events,update_ms,render_ms,present_ms,solved,drawn\n";
+
+    std::vector<double> work;
+    work.reserve(rows.size());
+    for (const Row& row : rows) {
+      const FrameTiming& t = row.timing;
+      csv << row.frame << ',' << row.events << ',' << t.updateMs << ',' << t.renderMs << ','
+          << t.presentMs << ',' << (t.solved ? 1 : 0) << ',' << (t.drawn ? 1 : 0) << '\n';
+      work.push_back(t.updateMs + t.renderMs);
+    }
+
+    std::sort(work.begin(), work.end());
+    double total = 0;
+    for (double w : work) total += w;
+    auto at = [&work](double p) { return work.empty() ? 0.0 : work[(size_t)(p * (work.size() - 1))]; };
+
+    std::cout << "replay: " << rows.size() << " frames, work " << total << " ms total, p50 " << at(0.50)
+              << " p95 " << at(0.95) << " max " << at(1.0) << " ms, timings in " << file << std::endl;
+  }
+
+  void finish() {
+    if (recording()) {
+      out.close();
+      std::cout << "replay: recorded " << frame << " frames to " << options.record << std::endl;
+      options.record.clear();
+    }
+
+    if (replaying()) {
+      writeTimings();
+      options.replay.clear();
+      pinnedClockMs() = -1;
+    }
+  }
+}
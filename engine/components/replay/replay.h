@@ -0,0 +1,57 @@
+#pragma once
+#include <SDL2/SDL.h>
+#include <string>
+
+// event recording and replay for performance regression runs. A recording
+// is every sdl event the main loop drained, tagged with its frame, plus a
+// marker per frame with the time it started. A replay feeds the events back
+// on the same frames with the clock pinned to the recorded frame times, and
+// writes the cost of every frame out as csv
+namespace Replay {
+  struct Options {
+    std::string record;
+    std::string replay;
+    // csv path, <replay>.timings.csv when empty
+    std::string timings;
+    // frames run back to back instead of at the recorded pace
+    bool uncapped = false;
+  };
+
+  // reads --record=, --replay=, --timings= and --uncapped
+  bool parseFlag(const std::string& arg, Options& options);
+
+  // opens the recording or loads the replay, false when the file can not be used
+  bool start(const Options& options, int w, int h);
+
+  bool recording();
+  bool replaying();
+
+  // window size the replay was recorded at, left alone otherwise
+  void windowSize(int& w, int& h);
+
+  // starts the next frame. Recording writes its marker, replaying waits for
+  // its recorded time unless uncapped and pins clockMs() to it. False once
+  // a replay ran out of frames
+  bool beginFrame(double now);
+
+  // recording keeps the event for the current frame
+  void record(const SDL_Event& event);
+
+  // replaying hands out the current frame's events one by one
+  bool next(SDL_Event& event);
+
+  struct FrameTiming {
+    // poll through layout, drawing and the gc step, and the present
+    double updateMs = 0;
+    double renderMs = 0;
+    double presentMs = 0;
+    bool solved = false;
+    bool drawn = false;
+  };
+
+  // kept for the timings file while replaying
+  void endFrame(const FrameTiming& timing);
+
+  // flushes the recording, or writes the timings and prints a summary
+  void finish();
+}
@@ -0,0 +1,56 @@
+#include "runtime.h"
+#include <string>
+#include "../state/state.h"
+#include "../stats/stats.h"
+#include "../refs/refs.h"
+#include "../style/style.h"
+#include "../loader/loader.h"
+#include "../tasks/tasks.h"
+#include "../timers/timers.h"
+
+namespace Runtime {
+
+  lua_State* newState() {
+    lua_State* L = luaL_newstate();
+    luaL_openlibs(L);
+    registerStateBindings(L);
+    registerStatsBindings(L);
+    registerTaskBindings(L);
+    registerTimerBindings(L);
+    registerRefBindings(L);
+    Style::initCache(L);
+
+    lua_getglobal(L, "package");
+    lua_getfield(L, -1, "path");
+    std::string paths = lua_tostring(L, -1);
+    lua_pop(L, 1);
+
+    paths =
+      "../?.lua;"
+      "../?/init.lua;"
+
+      "../utils/?.lua;"
+      "../utils/?/init.lua;"
+
+      "../src/?.lua;"
+      "../src/?/init.lua;"
+
+      "../lua/?.lua;"
+      "../lua/?/init.lua;"
+      + paths;
+    lua_pushstring(L, paths.c_str());
+    lua_setfield(L, -2, "path");
+    lua_pop(L, 1);
+
+    Loader::install(L);
+    return L;
+  }
+
+  const char* backendName() {
+#ifdef VULPIS_LUAJIT
+    return LUAJIT_VERSION;
+#else
+    return LUA_RELEASE;
+#endif
+  }
+}
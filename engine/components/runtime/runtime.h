@@ -0,0 +1,11 @@
+#pragma once
+#include "../../lua.hpp"
+
+namespace Runtime {
+  // new lua state with the engine bindings registered and the
+  // project directories on package.path
+  lua_State* newState();
+
+  // name and version of the lua implementation the engine was built against
+  const char* backendName();
+}
@@ -0,0 +1,361 @@
+#include "snapshot.h"
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include "../decor/decor.h"
+#include "../loader/loader.h"
+#include "../render/render.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace Snapshot {
+
+  static const char MAGIC[4] = {'V', 'L', 'S', 'N'};
+  static const uint32_t FORMAT_VERSION = 2;
+
+  // file: header, title, mode, sources, padding to 4, rects
+  struct Header {
+    char magic[4];
+    uint32_t version;
+    int32_t w, h;
+    uint32_t resizable;
+    uint32_t titleBytes;
+    uint32_t modeBytes;
+    uint32_t sourceCount;
+    uint32_t rectCount;
+  };
+
+  // a source is { int64 mtime, int64 size, uint32 pathBytes, path }.
+  // Plain backgrounds are stored already cut to their clip. Decorated nodes
+  // keep their whole box and the clip they are drawn under, the mesh is
+  // rebuilt from the style when painting
+  struct Rect {
+    int32_t x, y, w, h;
+    int32_t clipX, clipY, clipW, clipH;
+    uint8_t r, g, b, a;
+    uint8_t borderR, borderG, borderB, borderA;
+    uint8_t shadowR, shadowG, shadowB, shadowA;
+    uint8_t decorated, hasFill, shadow, unused;
+    float radius;
+    int32_t borderWidth;
+    float shadowX, shadowY, shadowBlur, shadowSpread;
+  };
+
+  static const char* data = nullptr;
+  static size_t dataSize = 0;
+  static std::string fallback;
+  static const Rect* rects = nullptr;
+  static uint32_t rectCount = 0;
+  static Window config;
+
+  static std::string path() {
+    std::string dir = Loader::cacheDirectory();
+    return dir.empty() ? "" : dir + "/snapshot.bin";
+  }
+
+  static bool statSource(const std::string& file, int64_t& mtime, int64_t& size) {
+    std::error_code ec;
+    auto bytes = fs::file_size(file, ec);
+    if (ec) return false;
+    auto time = fs::last_write_time(file, ec);
+    if (ec) return false;
+
+    size = (int64_t)bytes;
+    mtime = (int64_t)time.time_since_epoch().count();
+    return true;
+  }
+
+  static bool map(const std::string& file) {
+#ifndef _WIN32
+    int fd = ::open(file.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+      ::close(fd);
+      return false;
+    }
+
+    void* p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) return false;
+
+    data = (const char*)p;
+    dataSize = (size_t)st.st_size;
+    return true;
+#else
+    std::ifstream in(file, std::ios::binary);
+    if (!in) return false;
+    fallback.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    data = fallback.data();
+    dataSize = fallback.size();
+    return dataSize > 0;
+#endif
+  }
+
+  void close() {
+#ifndef _WIN32
+    if (data) munmap((void*)data, dataSize);
+#else
+    fallback.clear();
+#endif
+    data = nullptr;
+    dataSize = 0;
+    rects = nullptr;
+    rectCount = 0;
+  }
+
+  // bounds checked reader over the mapped bytes
+  struct Reader {
+    size_t at = 0;
+
+    bool read(void* out, size_t n) {
+      if (at + n > dataSize) return false;
+      std::memcpy(out, data + at, n);
+      at += n;
+      return true;
+    }
+
+    bool readString(std::string& out, size_t n) {
+      if (at + n > dataSize) return false;
+      out.assign(data + at, n);
+      at += n;
+      return true;
+    }
+  };
+
+  static bool validate() {
+    Reader in;
+    Header header;
+    if (!in.read(&header, sizeof(header))) return false;
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0) return false;
+    if (header.version != FORMAT_VERSION) return false;
+
+    config.w = header.w;
+    config.h = header.h;
+    config.resizable = header.resizable != 0;
+    if (!in.readString(config.title, header.titleBytes)) return false;
+    if (!in.readString(config.mode, header.modeBytes)) return false;
+
+    for (uint32_t i = 0; i < header.sourceCount; i++) {
+      int64_t mtime, size;
+      uint32_t pathBytes;
+      std::string file;
+      if (!in.read(&mtime, sizeof(mtime)) || !in.read(&size, sizeof(size))) return false;
+      if (!in.read(&pathBytes, sizeof(pathBytes)) || !in.readString(file, pathBytes)) return false;
+
+      int64_t nowMtime, nowSize;
+      if (!statSource(file, nowMtime, nowSize)) return false;
+      if (nowMtime != mtime || nowSize != size) return false;
+    }
+
+    in.at = (in.at + 3) & ~(size_t)3;
+    if (in.at + (size_t)header.rectCount * sizeof(Rect) > dataSize) return false;
+
+    rects = (const Rect*)(data + in.at);
+    rectCount = header.rectCount;
+    return true;
+  }
+
+  bool open() {
+    std::string file = path();
+    if (file.empty() || !map(file)) return false;
+
+    if (!validate()) {
+      close();
+      return false;
+    }
+    return true;
+  }
+
+  const Window& window() {
+    return config;
+  }
+
+  void paint(SDL_Renderer* r) {
+    SDL_SetRenderDrawColor(r, 30, 30, 30, 255);
+    SDL_RenderClear(r);
+
+    Render::SdlBackend backend(r);
+    // stands in for the recorded nodes while Decor builds their meshes
+    std::unique_ptr<Node> stand;
+
+    for (uint32_t i = 0; i < rectCount; i++) {
+      const Rect& rect = rects[i];
+      if (!rect.decorated) {
+        SDL_Rect box = {rect.x, rect.y, rect.w, rect.h};
+        SDL_SetRenderDrawColor(r, rect.r, rect.g, rect.b, rect.a);
+        SDL_RenderFillRect(r, &box);
+        continue;
+      }
+
+      if (!stand) stand = std::make_unique<Node>();
+      Node& n = *stand;
+      n.w = (float)rect.w;
+      n.h = (float)rect.h;
+      n.hasBackground = rect.hasFill != 0;
+      n.color = {rect.r, rect.g, rect.b, rect.a};
+      n.borderRadius = rect.radius;
+      n.borderWidth = rect.borderWidth;
+      n.borderColor = {rect.borderR, rect.borderG, rect.borderB, rect.borderA};
+      n.shadow.enabled = rect.shadow != 0;
+      n.shadow.x = rect.shadowX;
+      n.shadow.y = rect.shadowY;
+      n.shadow.blur = rect.shadowBlur;
+      n.shadow.spread = rect.shadowSpread;
+      n.shadow.color = {rect.shadowR, rect.shadowG, rect.shadowB, rect.shadowA};
+
+      backend.setClip({rect.clipX, rect.clipY, rect.clipW, rect.clipH});
+      Decor::draw(backend, &n, (float)rect.x, (float)rect.y);
+      SDL_RenderSetClipRect(r, nullptr);
+    }
+
+    if (stand) Decor::release(stand.get());
+  }
+
+  struct ClipFrame {
+    Node* node;
+    SDL_Rect clip;
+  };
+
+  static Rect decorated(const Node* n, const SDL_Rect& box, const SDL_Rect& clip) {
+    Rect rect = {};
+    rect.x = box.x;
+    rect.y = box.y;
+    rect.w = box.w;
+    rect.h = box.h;
+    rect.clipX = clip.x;
+    rect.clipY = clip.y;
+    rect.clipW = clip.w;
+    rect.clipH = clip.h;
+    rect.r = n->color.r;
+    rect.g = n->color.g;
+    rect.b = n->color.b;
+    rect.a = n->color.a;
+    rect.borderR = n->borderColor.r;
+    rect.borderG = n->borderColor.g;
+    rect.borderB = n->borderColor.b;
+    rect.borderA = n->borderColor.a;
+    rect.shadowR = n->shadow.color.r;
+    rect.shadowG = n->shadow.color.g;
+    rect.shadowB = n->shadow.color.b;
+    rect.shadowA = n->shadow.color.a;
+    rect.decorated = 1;
+    rect.hasFill = n->hasBackground ? 1 : 0;
+    rect.shadow = n->shadow.enabled ? 1 : 0;
+    rect.radius = n->borderRadius;
+    rect.borderWidth = n->borderWidth;
+    rect.shadowX = n->shadow.x;
+    rect.shadowY = n->shadow.y;
+    rect.shadowBlur = n->shadow.blur;
+    rect.shadowSpread = n->shadow.spread;
+    return rect;
+  }
+
+  // same walk as drawNode. Plain fills are cut down to the clip they would
+  // get, decorated nodes are kept whole since a shadow can reach past the box
+  static void collect(Node* root, const SDL_Rect& rootClip, std::vector<Rect>& out) {
+    std::vector<ClipFrame> stack;
+    stack.push_back({root, rootClip});
+
+    while (!stack.empty()) {
+      ClipFrame f = stack.back();
+      stack.pop_back();
+      Node* n = f.node;
+      if (n->displayNone) continue;
+
+      SDL_Rect nodeBox = {(int)n->x, (int)n->y, (int)n->w, (int)n->h};
+      SDL_Rect visible;
+      bool isVisible = SDL_IntersectRect(&f.clip, &nodeBox, &visible);
+
+      if (Decor::needed(n)) {
+        out.push_back(decorated(n, nodeBox, f.clip));
+      } else if (n->hasBackground && isVisible) {
+        Rect rect = {};
+        rect.x = rect.clipX = visible.x;
+        rect.y = rect.clipY = visible.y;
+        rect.w = rect.clipW = visible.w;
+        rect.h = rect.clipH = visible.h;
+        rect.r = n->color.r;
+        rect.g = n->color.g;
+        rect.b = n->color.b;
+        rect.a = n->color.a;
+        out.push_back(rect);
+      }
+
+      if (!isVisible) continue;
+      for (size_t i = n->children.size(); i-- > 0;) {
+        stack.push_back({n->children[i], visible});
+      }
+    }
+  }
+
+  template <typename T>
+  static void append(std::string& out, const T& value) {
+    out.append((const char*)&value, sizeof(T));
+  }
+
+  void save(Node* root, const Window& window, const std::vector<std::string>& sources) {
+    std::string file = path();
+    if (file.empty() || !root) return;
+
+    std::vector<Rect> list;
+    collect(root, SDL_Rect{0, 0, (int)root->w, (int)root->h}, list);
+
+    Header header;
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = FORMAT_VERSION;
+    header.w = window.w;
+    header.h = window.h;
+    header.resizable = window.resizable ? 1 : 0;
+    header.titleBytes = (uint32_t)window.title.size();
+    header.modeBytes = (uint32_t)window.mode.size();
+    header.sourceCount = 0;
+    header.rectCount = (uint32_t)list.size();
+
+    std::string body;
+    for (const std::string& source : sources) {
+      int64_t mtime, size;
+      if (!statSource(source, mtime, size)) continue;
+      append(body, mtime);
+      append(body, size);
+      append(body, (uint32_t)source.size());
+      body.append(source);
+      header.sourceCount++;
+    }
+
+    std::string bytes;
+    append(bytes, header);
+    bytes.append(window.title);
+    bytes.append(window.mode);
+    bytes.append(body);
+    bytes.resize((bytes.size() + 3) & ~(size_t)3, '\0');
+    bytes.append((const char*)list.data(), list.size() * sizeof(Rect));
+
+    if (data && dataSize == bytes.size() && std::memcmp(data, bytes.data(), dataSize) == 0) {
+      return;
+    }
+
+    std::error_code ec;
+    fs::create_directories(fs::path(file).parent_path(), ec);
+
+    // same as the bytecode cache, never leave half a file behind
+    std::string tmp = file + ".tmp";
+    {
+      std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+      if (!out) return;
+      out.write(bytes.data(), bytes.size());
+      if (!out) return;
+    }
+    fs::rename(tmp, file, ec);
+  }
+}
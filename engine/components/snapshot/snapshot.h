@@ -0,0 +1,37 @@
+#pragma once
+#include <SDL2/SDL.h>
+#include <string>
+#include <vector>
+#include "../ui/ui.h"
+
+// warm start, the laid out tree of the last launch is kept as a flat list of
+// clipped backgrounds, borders, radii and shadows in
+// .vulpis-cache/snapshot.bin. It is mapped and
+// painted while app.lua is still loading, then the live tree takes over
+namespace Snapshot {
+  struct Window {
+    int w = 0, h = 0;
+    std::string title;
+    std::string mode;
+    bool resizable = false;
+
+    bool operator==(const Window& o) const {
+      return w == o.w && h == o.h && title == o.title && mode == o.mode && resizable == o.resizable;
+    }
+  };
+
+  // maps the snapshot, false when it is missing, from another format version,
+  // or any source it was built from changed since
+  bool open();
+
+  // window config the snapshot was taken with, valid after open()
+  const Window& window();
+
+  // clears the target and fills the snapshot rects in paint order
+  void paint(SDL_Renderer* r);
+
+  // writes the current tree, skipped when it matches the mapped snapshot
+  void save(Node* root, const Window& window, const std::vector<std::string>& sources);
+
+  void close();
+}
@@ -1,13 +1,21 @@
 #include "state.h"
 #include <lauxlib.h>
 #include <lua.h>
+#include <climits>
+#include <cmath>
 #include <variant>
 
+StateValue numberState(double n) {
+  // casting first is undefined for values outside the int range
+  if (n >= INT_MIN && n <= INT_MAX && n == std::floor(n)) return (int)n;
+  return n;
+}
+
 void pushStateValue(lua_State* L, const StateValue& val) {
   if (std::holds_alternative<int>(val)) {
     lua_pushinteger(L, std::get<int>(val));
-  } else if (std::holds_alternative<float>(val)) {
-    lua_pushnumber(L, std::get<float>(val));
+  } else if (std::holds_alternative<double>(val)) {
+    lua_pushnumber(L, std::get<double>(val));
   } else if (std::holds_alternative<std::string>(val)) {
     lua_pushstring(L, std::get<std::string>(val).c_str());
   } else if (std::holds_alternative<bool>(val)) {
@@ -24,9 +32,7 @@ int l_setState(lua_State* L) {
   int type = lua_type(L, 2);
 
   if (type == LUA_TNUMBER) {
-    double d = lua_tonumber(L, 2);
-    if (d == (int)d) val = (int)d;
-    else val = (float)d;
+    val = numberState(lua_tonumber(L, 2));
   }
 
   else if (type == LUA_TSTRING) {
@@ -53,9 +59,7 @@ int l_useState(lua_State* L) {
   if (lua_gettop(L) >= 2) {
     int type = lua_type(L, 2);
     if (type == LUA_TNUMBER) {
-      double d = lua_tonumber(L, 2);
-      if (d == (int)d) defVal = (int)d;
-      else defVal = (float)d;
+      defVal = numberState(lua_tonumber(L, 2));
     } else if (type == LUA_TSTRING) {
       defVal = std::string(lua_tostring(L, 2));
     } else if (type == LUA_TBOOLEAN) {
@@ -11,7 +11,10 @@
 #include <vector>
 #include "../../lua.hpp"
 
-using StateValue = std::variant<int, float, std::string, bool>;
+using StateValue = std::variant<int, double, std::string, bool>;
+
+// whole numbers that fit an int are stored as int, anything else as double
+StateValue numberState(double n);
 
 class StateManager {
   public:
@@ -40,6 +43,22 @@ class StateManager {
       dirty = false;
     }
 
+    size_t size() const {
+      return store.size();
+    }
+
+    // key and string value bytes
+    size_t bytes() const {
+      size_t total = 0;
+      for (const auto& [key, value] : store) {
+        total += key.capacity();
+        if (const std::string* s = std::get_if<std::string>(&value)) {
+          total += s->capacity();
+        }
+      }
+      return total;
+    }
+
   private:
     std::unordered_map<std::string, StateValue> store;
     bool dirty = false;
@@ -0,0 +1,100 @@
+#include "stats.h"
+#include "../arena/arena.h"
+#include "../latency/latency.h"
+#include "../memory/memory.h"
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+static void setNumber(lua_State* L, const char* key, double value) {
+  lua_pushnumber(L, value);
+  lua_setfield(L, -2, key);
+}
+
+int l_stats(lua_State* L) {
+  EngineStats& s = EngineStats::instance();
+  Memory::sample(L);
+
+  lua_newtable(L);
+  setNumber(L, "appLoadMs", s.appLoadMs);
+  setNumber(L, "firstFrameMs", s.firstFrameMs);
+  setNumber(L, "warmFrameMs", s.warmFrameMs);
+  setNumber(L, "frames", (double)s.frames);
+  setNumber(L, "frameTimeMs", s.frameTimeMs);
+  setNumber(L, "layoutSolves", (double)s.layoutSolves);
+  setNumber(L, "luaHeapBytes", (double)s.luaHeapBytes);
+  setNumber(L, "gcTimeMs", s.gcTimeMs);
+  setNumber(L, "gcTimeTotalMs", s.gcTimeTotalMs);
+  setNumber(L, "gcCycles", (double)s.gcCycles);
+  setNumber(L, "textureBytes", (double)s.textureBytes);
+  setNumber(L, "meshBuilds", (double)s.meshBuilds);
+  setNumber(L, "inputEvents", (double)s.inputEvents);
+  setNumber(L, "inputCoalesced", (double)s.inputCoalesced);
+  setNumber(L, "inputHandlers", (double)s.inputHandlers);
+  setNumber(L, "tasksInFlight", (double)s.tasksInFlight);
+  setNumber(L, "tasksCompleted", (double)s.tasksCompleted);
+  setNumber(L, "timersActive", (double)s.timersActive);
+  setNumber(L, "timersFired", (double)s.timersFired);
+  setNumber(L, "animations", (double)s.animations);
+  setNumber(L, "liveNodes", (double)s.liveNodes);
+  setNumber(L, "nodeBytes", (double)s.nodeBytes);
+  setNumber(L, "yogaNodes", (double)s.yogaNodes);
+  setNumber(L, "layoutApplied", (double)s.layoutApplied);
+  setNumber(L, "callbackRefs", (double)s.callbackRefs);
+  setNumber(L, "stateEntries", (double)s.stateEntries);
+  setNumber(L, "stateBytes", (double)s.stateBytes);
+  setNumber(L, "arenaBytes", (double)Arena::capacity());
+
+  std::vector<EngineStats::Stage> stages = s.stages();
+  lua_createtable(L, (int)stages.size(), 0);
+  for (size_t i = 0; i < stages.size(); i++) {
+    lua_newtable(L);
+    lua_pushstring(L, stages[i].name.c_str());
+    lua_setfield(L, -2, "name");
+    setNumber(L, "startMs", stages[i].startMs);
+    setNumber(L, "durationMs", stages[i].endMs - stages[i].startMs);
+    lua_rawseti(L, -2, (int)i + 1);
+  }
+  lua_setfield(L, -2, "startup");
+
+  // ms from an input event to the end of each stage of the frame that showed it
+  lua_newtable(L);
+  setNumber(L, "samples", (double)Latency::samples());
+  for (int i = 0; i < (int)Latency::Stage::Count; i++) {
+    Latency::Percentiles p = Latency::percentiles((Latency::Stage)i);
+    lua_newtable(L);
+    setNumber(L, "p50", p.p50);
+    setNumber(L, "p95", p.p95);
+    setNumber(L, "p99", p.p99);
+    lua_setfield(L, -2, Latency::stageName((Latency::Stage)i));
+  }
+  setNumber(L, "frameBudgetMs", Latency::adaptive() ? Latency::frameBudget() : 0);
+  lua_setfield(L, -2, "latency");
+  return 1;
+}
+
+void reportStartup(const char* target) {
+  EngineStats& s = EngineStats::instance();
+
+  std::ostringstream line;
+  line << "startup: first frame " << s.firstFrameMs << " ms";
+  if (s.warmFrameMs > 0) line << " (snapshot at " << s.warmFrameMs << " ms)";
+  for (const EngineStats::Stage& stage : s.stages()) {
+    line << " | " << stage.name << " @" << stage.startMs << " +" << (stage.endMs - stage.startMs);
+  }
+
+  if (std::strcmp(target, "1") == 0) {
+    std::cout << line.str() << std::endl;
+  } else {
+    std::ofstream out(target, std::ios::app);
+    out << line.str() << '\n';
+  }
+}
+
+void registerStatsBindings(lua_State* L) {
+  pushVulpisTable(L);
+  lua_pushcfunction(L, l_stats);
+  lua_setfield(L, -2, "stats");
+  lua_pop(L, 1);
+}
@@ -0,0 +1,111 @@
+#pragma once
+#include <SDL2/SDL.h>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "../../lua.hpp"
+
+// monotonic time in milliseconds
+inline double nowMs() {
+  static const double freq = (double)SDL_GetPerformanceFrequency();
+  return (double)SDL_GetPerformanceCounter() * 1000.0 / freq;
+}
+
+// set while a replay runs every frame at the time it was recorded at, -1 otherwise
+inline double& pinnedClockMs() {
+  static double pinned = -1;
+  return pinned;
+}
+
+// what timers and transitions count from, nowMs() unless a replay pinned it
+inline double clockMs() {
+  double pinned = pinnedClockMs();
+  return pinned >= 0 ? pinned : nowMs();
+}
+
+class EngineStats {
+  public:
+    static EngineStats& instance() {
+      static EngineStats instance;
+      return instance;
+    }
+
+    // startup, all relative to startMs
+    struct Stage {
+      std::string name;
+      double startMs;
+      double endMs;
+    };
+
+    double startMs = 0;
+    double appLoadMs = 0;
+    double firstFrameMs = 0;
+    // first frame painted from the warm start snapshot, 0 without one
+    double warmFrameMs = 0;
+
+    // startup stages run on more than one thread
+    void recordStage(const char* name, double stageStartMs) {
+      std::lock_guard<std::mutex> lock(stageMutex);
+      stageList.push_back({name, stageStartMs - startMs, nowMs() - startMs});
+    }
+
+    std::vector<Stage> stages() {
+      std::lock_guard<std::mutex> lock(stageMutex);
+      return stageList;
+    }
+
+    // frame
+    unsigned long long frames = 0;
+    double frameTimeMs = 0;
+    unsigned long long layoutSolves = 0;
+
+    // input, events drained from sdl and how many were folded into others
+    unsigned long long inputEvents = 0;
+    unsigned long long inputCoalesced = 0;
+    unsigned long long inputHandlers = 0;
+
+    // background tasks
+    size_t tasksInFlight = 0;
+    unsigned long long tasksCompleted = 0;
+
+    // setTimeout / setInterval
+    size_t timersActive = 0;
+    unsigned long long timersFired = 0;
+
+    // running style transitions
+    size_t animations = 0;
+
+    // render layers
+    size_t textureBytes = 0;
+
+    // rounded corner, border and shadow meshes built since start
+    unsigned long long meshBuilds = 0;
+
+    // memory, refreshed by Memory::sample
+    size_t liveNodes = 0;
+    size_t nodeBytes = 0;
+    // live yoga nodes, and nodes whose rect the last solve wrote
+    size_t yogaNodes = 0;
+    size_t layoutApplied = 0;
+    size_t callbackRefs = 0;
+    size_t stateEntries = 0;
+    size_t stateBytes = 0;
+
+    // lua gc
+    size_t luaHeapBytes = 0;
+    double gcTimeMs = 0;
+    double gcTimeTotalMs = 0;
+    unsigned long long gcCycles = 0;
+
+  private:
+    EngineStats() = default;
+    std::mutex stageMutex;
+    std::vector<Stage> stageList;
+};
+
+// prints the startup timeline, or appends it to a file when target is not "1"
+void reportStartup(const char* target);
+
+// registers vulpis.stats()
+void registerStatsBindings(lua_State* L);
@@ -0,0 +1,561 @@
+#include "style.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstring>
+#include <cstdlib>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "../color/color.h"
+#include "../animation/animation.h"
+#include "../arena/arena.h"
+
+namespace Style {
+
+  static bool operator==(const Length& a, const Length& b) {
+    return a.value == b.value && a.type == b.type;
+  }
+
+  static bool operator==(const SDL_Color& a, const SDL_Color& b) {
+    return a.r == b.r && a.g == b.g && a.b == b.b && a.a == b.a;
+  }
+
+  template <typename T>
+  static bool set(T& field, const T& value) {
+    if (field == value) return false;
+    field = value;
+    return true;
+  }
+
+  template <typename T, T Node::*F>
+  static bool copyField(Node* dst, const Node* src) {
+    return set(dst->*F, src->*F);
+  }
+
+  // lua interns short strings and the style tables of a tree repeat the
+  // same few values, so parsed strings are cached by their pointer. Cached
+  // strings are pinned in a registry table so the pointer can not be freed
+  // and reused for a different string while its entry exists
+  struct ParseCache {
+    lua_State* L = nullptr;
+    int pinRef = LUA_NOREF;
+    size_t size = 0;
+    std::unordered_map<const char*, Length> lengths;
+    std::unordered_map<const char*, SDL_Color> colors;
+  };
+
+  // a cap for apps that build style strings on the fly
+  static const size_t PARSE_CACHE_LIMIT = 4096;
+
+  static ParseCache cache;
+
+  void initCache(lua_State* L) {
+    cache.lengths.clear();
+    cache.colors.clear();
+    cache.size = 0;
+    cache.L = L;
+    lua_newtable(L);
+    cache.pinRef = luaL_ref(L, LUA_REGISTRYINDEX);
+  }
+
+  // pins the string at idx, false when it can not be cached
+  static bool pin(lua_State* L, int idx) {
+    if (L != cache.L || cache.pinRef == LUA_NOREF || !lua_checkstack(L, 3)) return false;
+
+    if (cache.size >= PARSE_CACHE_LIMIT) {
+      luaL_unref(L, LUA_REGISTRYINDEX, cache.pinRef);
+      initCache(L);
+    }
+
+    lua_pushvalue(L, idx);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, cache.pinRef);
+    lua_insert(L, -2);
+    lua_pushboolean(L, 1);
+    lua_rawset(L, -3);
+    lua_pop(L, 1);
+    cache.size++;
+    return true;
+  }
+
+  // "50%" or a numeric string like "100", which lua_isnumber took as pixels
+  static Length parseLength(const char* s) {
+    char* end = nullptr;
+    float value = std::strtof(s, &end);
+    if (end == s) return Length(0);
+    if (end[0] == '%' && end[1] == '\0') return Length::Percent(value);
+    while (std::isspace((unsigned char)*end)) end++;
+    if (*end == '\0') return Length(value);
+    return Length(0);
+  }
+
+  Length toLength(lua_State* L, int idx) {
+    if (lua_type(L, idx) == LUA_TNUMBER) {
+      return Length((float)lua_tonumber(L, idx));
+    }
+
+    if (lua_type(L, idx) == LUA_TSTRING) {
+      const char* s = lua_tostring(L, idx);
+      if (L == cache.L) {
+        auto it = cache.lengths.find(s);
+        if (it != cache.lengths.end()) return it->second;
+      }
+
+      Length length = parseLength(s);
+      if (pin(L, idx)) cache.lengths.emplace(s, length);
+      return length;
+    }
+
+    return Length(0);
+  }
+
+  template <Length Node::*F>
+  static bool applyLength(lua_State* L, Node* n) {
+    return set(n->*F, toLength(L, -1));
+  }
+
+  template <Length Node::*F>
+  static void getLength(const Node* n, float* out) {
+    // percentages resolve against the parent, they jump instead
+    out[0] = (n->*F).type == PIXEL ? (n->*F).value : NAN;
+  }
+
+  template <Length Node::*F>
+  static void setLength(Node* n, const float* in) {
+    (n->*F).value = in[0];
+  }
+
+  template <int Node::*F>
+  static bool applyInt(lua_State* L, Node* n) {
+    int v = lua_isnumber(L, -1) ? (int)lua_tointeger(L, -1) : 0;
+    return set(n->*F, v);
+  }
+
+  template <int Node::*F>
+  static void getInt(const Node* n, float* out) {
+    out[0] = (float)(n->*F);
+  }
+
+  template <int Node::*F>
+  static void setInt(Node* n, const float* in) {
+    n->*F = (int)std::lround(in[0]);
+  }
+
+  template <float Node::*F, int Default>
+  static bool applyFloat(lua_State* L, Node* n) {
+    float v = lua_isnumber(L, -1) ? (float)lua_tonumber(L, -1) : (float)Default;
+    return set(n->*F, v);
+  }
+
+  template <float Node::*F>
+  static void getFloat(const Node* n, float* out) {
+    out[0] = n->*F;
+  }
+
+  template <float Node::*F>
+  static void setFloat(Node* n, const float* in) {
+    n->*F = in[0];
+  }
+
+  static bool applyAlign(lua_State* L, Node* n) {
+    return set(n->alignItems, parseAlign(lua_isstring(L, -1) ? lua_tostring(L, -1) : "start"));
+  }
+
+  static bool applyJustify(lua_State* L, Node* n) {
+    return set(n->justifyContent, parseJustify(lua_isstring(L, -1) ? lua_tostring(L, -1) : "start"));
+  }
+
+  // "#rrggbb[aa]", a color name or { r, g, b, a }, false for anything else
+  static bool readColor(lua_State* L, int idx, SDL_Color& color) {
+    if (lua_type(L, idx) == LUA_TSTRING) {
+      const char* s = lua_tostring(L, idx);
+      if (L == cache.L) {
+        auto it = cache.colors.find(s);
+        if (it != cache.colors.end()) {
+          color = it->second;
+          return true;
+        }
+      }
+
+      color = parseColor(s);
+      if (pin(L, idx)) cache.colors.emplace(s, color);
+      return true;
+    }
+    if (lua_istable(L, idx)) {
+      lua_rawgeti(L, idx, 1); color.r = luaL_optinteger(L, -1, 255); lua_pop(L, 1);
+      lua_rawgeti(L, idx, 2); color.g = luaL_optinteger(L, -1, 255); lua_pop(L, 1);
+      lua_rawgeti(L, idx, 3); color.b = luaL_optinteger(L, -1, 255); lua_pop(L, 1);
+      lua_rawgeti(L, idx, 4); color.a = luaL_optinteger(L, -1, 255); lua_pop(L, 1);
+      return true;
+    }
+    return false;
+  }
+
+  static bool applyBackground(lua_State* L, Node* n) {
+    SDL_Color color = {0, 0, 0, 0};
+    bool hasBackground = readColor(L, lua_gettop(L), color);
+    if (!hasBackground) {
+      color = n->color;
+    }
+
+    bool changed = set(n->hasBackground, hasBackground);
+    return set(n->color, color) || changed;
+  }
+
+  static bool copyBackground(Node* dst, const Node* src) {
+    bool changed = set(dst->hasBackground, src->hasBackground);
+    return set(dst->color, src->color) || changed;
+  }
+
+  static void getBackground(const Node* n, float* out) {
+    if (!n->hasBackground) {
+      out[0] = out[1] = out[2] = out[3] = NAN;
+      return;
+    }
+    out[0] = n->color.r;
+    out[1] = n->color.g;
+    out[2] = n->color.b;
+    out[3] = n->color.a;
+  }
+
+  static Uint8 toChannel(float v) {
+    return (Uint8)std::lround(std::min(255.0f, std::max(0.0f, v)));
+  }
+
+  static void setBackground(Node* n, const float* in) {
+    n->color = {toChannel(in[0]), toChannel(in[1]), toChannel(in[2]), toChannel(in[3])};
+    n->hasBackground = true;
+  }
+
+  static bool applyBorderColor(lua_State* L, Node* n) {
+    SDL_Color color = {0, 0, 0, 255};
+    readColor(L, lua_gettop(L), color);
+    return set(n->borderColor, color);
+  }
+
+  static void getBorderColor(const Node* n, float* out) {
+    out[0] = n->borderColor.r;
+    out[1] = n->borderColor.g;
+    out[2] = n->borderColor.b;
+    out[3] = n->borderColor.a;
+  }
+
+  static void setBorderColor(Node* n, const float* in) {
+    n->borderColor = {toChannel(in[0]), toChannel(in[1]), toChannel(in[2]), toChannel(in[3])};
+  }
+
+  static float numberField(lua_State* L, const char* key) {
+    lua_getfield(L, -1, key);
+    float v = lua_isnumber(L, -1) ? (float)lua_tonumber(L, -1) : 0.0f;
+    lua_pop(L, 1);
+    return v;
+  }
+
+  // boxShadow = { x = 0, y = 4, blur = 12, spread = 0, color = "#00000066" }
+  static bool applyShadow(lua_State* L, Node* n) {
+    BoxShadow shadow;
+    if (lua_istable(L, -1)) {
+      shadow.enabled = true;
+      shadow.x = numberField(L, "x");
+      shadow.y = numberField(L, "y");
+      shadow.blur = std::max(0.0f, numberField(L, "blur"));
+      shadow.spread = numberField(L, "spread");
+      shadow.color = {0, 0, 0, 128};
+      lua_getfield(L, -1, "color");
+      readColor(L, lua_gettop(L), shadow.color);
+      lua_pop(L, 1);
+    }
+    return set(n->shadow, shadow);
+  }
+
+  static bool applyDisplay(lua_State* L, Node* n) {
+    bool none = lua_type(L, -1) == LUA_TSTRING && std::strcmp(lua_tostring(L, -1), "none") == 0;
+    return set(n->displayNone, none);
+  }
+
+  static bool applyLayer(lua_State* L, Node* n) {
+    return set(n->isLayer, (bool)lua_toboolean(L, -1));
+  }
+
+  static Easing parseEasing(const char* s) {
+    if (std::strcmp(s, "linear") == 0) return Easing::Linear;
+    if (std::strcmp(s, "ease-in") == 0) return Easing::EaseIn;
+    if (std::strcmp(s, "ease-out") == 0) return Easing::EaseOut;
+    return Easing::EaseInOut;
+  }
+
+  // a spec as parsed from the style table, the property is a view into the lua key
+  struct TransitionView {
+    std::string_view property;
+    float durationMs;
+    Easing easing;
+    bool spring;
+    float stiffness;
+    float damping;
+  };
+
+  static bool sameSpec(const TransitionSpec& spec, const TransitionView& v) {
+    return spec.property == v.property && spec.durationMs == v.durationMs && spec.easing == v.easing &&
+      spec.spring == v.spring && spec.stiffness == v.stiffness && spec.damping == v.damping;
+  }
+
+  // transition = { BGColor = 200, w = { duration = 300, easing = "ease-out" },
+  //                h = { spring = { stiffness = 170, damping = 26 } } }
+  // parsed into the frame arena and only copied to the node when it changed
+  static bool applyTransition(lua_State* L, Node* n) {
+    Arena::Scope scratch;
+    size_t entries = 0;
+    if (lua_istable(L, -1)) {
+      lua_pushnil(L);
+      while (lua_next(L, -2) != 0) {
+        entries++;
+        lua_pop(L, 1);
+      }
+    }
+
+    TransitionView* views = Arena::array<TransitionView>(entries);
+    size_t count = 0;
+
+    if (entries > 0) {
+      lua_pushnil(L);
+      while (lua_next(L, -2) != 0) {
+        if (lua_type(L, -2) == LUA_TSTRING) {
+          TransitionSpec defaults;
+          size_t len = 0;
+          const char* property = lua_tolstring(L, -2, &len);
+          TransitionView spec = {std::string_view(property, len), defaults.durationMs, defaults.easing,
+            defaults.spring, defaults.stiffness, defaults.damping};
+
+          if (lua_type(L, -1) == LUA_TNUMBER) {
+            spec.durationMs = (float)lua_tonumber(L, -1);
+          } else if (lua_istable(L, -1)) {
+            lua_getfield(L, -1, "duration");
+            if (lua_isnumber(L, -1)) spec.durationMs = (float)lua_tonumber(L, -1);
+            lua_pop(L, 1);
+
+            lua_getfield(L, -1, "easing");
+            if (lua_type(L, -1) == LUA_TSTRING) spec.easing = parseEasing(lua_tostring(L, -1));
+            lua_pop(L, 1);
+
+            lua_getfield(L, -1, "spring");
+            if (lua_istable(L, -1)) {
+              spec.spring = true;
+              lua_getfield(L, -1, "stiffness");
+              if (lua_isnumber(L, -1)) spec.stiffness = (float)lua_tonumber(L, -1);
+              lua_pop(L, 1);
+              lua_getfield(L, -1, "damping");
+              if (lua_isnumber(L, -1)) spec.damping = (float)lua_tonumber(L, -1);
+              lua_pop(L, 1);
+            } else if (lua_toboolean(L, -1)) {
+              spec.spring = true;
+            }
+            lua_pop(L, 1);
+          }
+
+          if (spec.spring || spec.durationMs > 0) views[count++] = spec;
+        }
+        lua_pop(L, 1);
+      }
+    }
+
+    bool same = n->transitions.size() == count;
+    for (size_t i = 0; same && i < count; i++) {
+      same = sameSpec(n->transitions[i], views[i]);
+    }
+    if (same) return false;
+
+    n->transitions.clear();
+    for (size_t i = 0; i < count; i++) {
+      TransitionSpec spec;
+      spec.property.assign(views[i].property.data(), views[i].property.size());
+      spec.durationMs = views[i].durationMs;
+      spec.easing = views[i].easing;
+      spec.spring = views[i].spring;
+      spec.stiffness = views[i].stiffness;
+      spec.damping = views[i].damping;
+      n->transitions.push_back(spec);
+    }
+    return true;
+  }
+
+  #define TRANSITION() \
+    { "transition", nullptr, Invalidation::None, applyTransition, \
+      copyField<std::vector<TransitionSpec>, &Node::transitions>, 0, nullptr, nullptr }
+  #define LENGTH(name, field) \
+    { name, nullptr, Invalidation::Layout, applyLength<&Node::field>, \
+      copyField<Length, &Node::field>, 1, getLength<&Node::field>, setLength<&Node::field> }
+  #define FLOAT(name, field, def) \
+    { name, nullptr, Invalidation::Layout, applyFloat<&Node::field, def>, \
+      copyField<float, &Node::field>, 1, getFloat<&Node::field>, setFloat<&Node::field> }
+  #define INT(name, fallback, field) \
+    { name, fallback, Invalidation::Layout, applyInt<&Node::field>, \
+      copyField<int, &Node::field>, 1, getInt<&Node::field>, setInt<&Node::field> }
+  #define LAYOUT(name, apply, type, field) \
+    { name, nullptr, Invalidation::Layout, apply, copyField<type, &Node::field>, 0, nullptr, nullptr }
+  #define PAINT(name, apply, copy, channels, get, set) \
+    { name, nullptr, Invalidation::Paint, apply, copy, channels, get, set }
+
+  // transition comes first so the other entries see the current specs,
+  // base keys come before the keys that fall back to them
+  static const Property table[] = {
+    TRANSITION(),
+
+    LENGTH("w", widthStyle),
+    LENGTH("h", heightStyle),
+
+    FLOAT("minWidth", minWidth, 0),
+    FLOAT("maxWidth", maxWidth, 99999),
+    FLOAT("minHeight", minHeight, 0),
+    FLOAT("maxHeight", maxHeight, 99999),
+
+    FLOAT("flexGrow", flexGrow, 0),
+    LAYOUT("alignItems", applyAlign, Align, alignItems),
+    LAYOUT("justifyContent", applyJustify, Justify, justifyContent),
+    LAYOUT("display", applyDisplay, bool, displayNone),
+
+    // we have support for both gap and spacing
+    INT("gap", "spacing", spacing),
+
+    INT("padding", nullptr, padding),
+    INT("paddingTop", "padding", paddingTop),
+    INT("paddingBottom", "padding", paddingBottom),
+    INT("paddingLeft", "padding", paddingLeft),
+    INT("paddingRight", "padding", paddingRight),
+
+    INT("margin", nullptr, margin),
+    INT("marginTop", "margin", marginTop),
+    INT("marginBottom", "margin", marginBottom),
+    INT("marginLeft", "margin", marginLeft),
+    INT("marginRight", "margin", marginRight),
+
+    PAINT("BGColor", applyBackground, copyBackground, 4, getBackground, setBackground),
+    PAINT("borderRadius", (applyFloat<&Node::borderRadius, 0>), (copyField<float, &Node::borderRadius>),
+          1, getFloat<&Node::borderRadius>, setFloat<&Node::borderRadius>),
+    PAINT("borderWidth", applyInt<&Node::borderWidth>, (copyField<int, &Node::borderWidth>),
+          1, getInt<&Node::borderWidth>, setInt<&Node::borderWidth>),
+    PAINT("borderColor", applyBorderColor, (copyField<SDL_Color, &Node::borderColor>),
+          4, getBorderColor, setBorderColor),
+    PAINT("boxShadow", applyShadow, (copyField<BoxShadow, &Node::shadow>), 0, nullptr, nullptr),
+    PAINT("layer", applyLayer, (copyField<bool, &Node::isLayer>), 0, nullptr, nullptr),
+  };
+
+  #undef TRANSITION
+  #undef LENGTH
+  #undef FLOAT
+  #undef INT
+  #undef LAYOUT
+  #undef PAINT
+
+  static const size_t tableSize = sizeof(table) / sizeof(table[0]);
+
+  const Property* properties(size_t& count) {
+    count = tableSize;
+    return table;
+  }
+
+  const Property* find(const char* name) {
+    for (size_t i = 0; i < tableSize; i++) {
+      if (std::strcmp(table[i].name, name) == 0) return &table[i];
+    }
+    return nullptr;
+  }
+
+  const TransitionSpec* findTransition(const Node* n, const Property& p) {
+    const TransitionSpec* fallback = nullptr;
+    for (const TransitionSpec& spec : n->transitions) {
+      if (spec.property == p.name) return &spec;
+      if (p.fallback && spec.property == p.fallback) fallback = &spec;
+    }
+    return fallback;
+  }
+
+  // true if the change was handed to the animation engine
+  static bool animateChange(Node* n, const Property& p, const float* from) {
+    float to[4];
+    p.get(n, to);
+    for (int c = 0; c < p.channels; c++) {
+      if (std::isnan(from[c]) || std::isnan(to[c])) {
+        // the new value jumps, a running animation would keep writing over it
+        Animation::cancel(n, &p);
+        return false;
+      }
+    }
+
+    const TransitionSpec* spec = findTransition(n, p);
+    p.set(n, from);
+    Animation::start(n, p, from, to, *spec);
+    return true;
+  }
+
+  // with `partial`, properties absent from the table keep their value
+  static Invalidation applyProperties(lua_State* L, Node* n, int styleIdx, bool animate, bool partial) {
+    Invalidation inv = Invalidation::None;
+    bool hasStyle = lua_istable(L, styleIdx);
+
+    for (size_t i = 0; i < tableSize; i++) {
+      const Property& p = table[i];
+
+      if (!hasStyle) {
+        lua_pushnil(L);
+      } else {
+        lua_getfield(L, styleIdx, p.name);
+        if (lua_isnil(L, -1) && p.fallback) {
+          lua_pop(L, 1);
+          lua_getfield(L, styleIdx, p.fallback);
+        }
+      }
+
+      if (partial && lua_isnil(L, -1)) {
+        lua_pop(L, 1);
+        continue;
+      }
+
+      bool transitions = animate && p.channels > 0 && findTransition(n, p);
+      if (!transitions && n->isAnimating && p.channels > 0) {
+        // the transition was removed, the property jumps to its value
+        Animation::cancel(n, &p);
+      }
+
+      float from[4];
+      if (transitions) p.get(n, from);
+
+      bool changed = p.apply(L, n);
+      if (changed && transitions && animateChange(n, p, from)) {
+        changed = false;
+      }
+
+      if (changed && p.invalidation > inv) {
+        inv = p.invalidation;
+      }
+      lua_pop(L, 1);
+    }
+
+    return inv;
+  }
+
+  Invalidation apply(lua_State* L, Node* n, int styleIdx, bool animate) {
+    return applyProperties(L, n, styleIdx, animate, false);
+  }
+
+  Invalidation patch(lua_State* L, Node* n, int styleIdx) {
+    return applyProperties(L, n, styleIdx, true, true);
+  }
+
+  Invalidation copy(Node* dst, const Node* src) {
+    Invalidation inv = Invalidation::None;
+    for (size_t i = 0; i < tableSize; i++) {
+      if (table[i].copy(dst, src) && table[i].invalidation > inv) {
+        inv = table[i].invalidation;
+      }
+    }
+    return inv;
+  }
+
+  void invalidate(Node* n, Invalidation inv) {
+    if (inv == Invalidation::Layout) {
+      n->makeLayoutDirty();
+    } else if (inv == Invalidation::Paint) {
+      n->makePaintDirty();
+    }
+  }
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <cstddef>
+#include "../ui/ui.h"
+
+namespace Style {
+
+  // what a change of a property invalidates, ordered so the strongest wins
+  enum class Invalidation {
+    None,
+    Paint,
+    Layout
+  };
+
+  struct Property {
+    const char* name;
+    // key read when `name` is absent, e.g. paddingTop falls back to padding
+    const char* fallback;
+    Invalidation invalidation;
+    // stores the lua value on top of the stack (nil when absent) into n, true if it changed
+    bool (*apply)(lua_State* L, Node* n);
+    // copies the property from src into dst, true if it changed
+    bool (*copy)(Node* dst, const Node* src);
+
+    // number of float channels a transition interpolates, 0 if not animatable
+    int channels;
+    // reads the channels, NaN where the current value can not be interpolated
+    void (*get)(const Node* n, float* out);
+    void (*set)(Node* n, const float* in);
+  };
+
+  const Property* properties(size_t& count);
+  const Property* find(const char* name);
+
+  // applies every property from the style table at styleIdx, keys that are
+  // absent (or a missing table) reset the property to its default. With
+  // `animate`, properties listed in the node's transitions are handed to the
+  // animation engine instead of jumping to the new value
+  Invalidation apply(lua_State* L, Node* n, int styleIdx, bool animate = false);
+
+  // applies only the properties the style table at styleIdx sets, everything
+  // else keeps its value. Transitions of the node apply as in `apply`
+  Invalidation patch(lua_State* L, Node* n, int styleIdx);
+
+  // copies every property of src into dst
+  Invalidation copy(Node* dst, const Node* src);
+
+  // transition of n covering p (directly or through its fallback key), nullptr if none
+  const TransitionSpec* findTransition(const Node* n, const Property& p);
+
+  // dirties n for the given invalidation
+  void invalidate(Node* n, Invalidation inv);
+
+  Length toLength(lua_State* L, int idx);
+
+  // resets the cache of parsed style strings for a new state
+  void initCache(lua_State* L);
+}
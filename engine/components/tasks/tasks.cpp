@@ -0,0 +1,372 @@
+#include "tasks.h"
+#include <SDL2/SDL.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "../dispatch/dispatch.h"
+#include "../state/state.h"
+#include "../stats/stats.h"
+
+namespace fs = std::filesystem;
+
+namespace Tasks {
+
+  // where a result goes, exactly one of these is set
+  struct Target {
+    int callbackRef = LUA_NOREF;
+    std::string stateKey;
+    int threadRef = LUA_NOREF;
+    lua_State* thread = nullptr;
+  };
+
+  struct Pending {
+    std::function<Push()> work;
+    Target target;
+  };
+
+  struct Done {
+    Push push;
+    Target target;
+  };
+
+  static std::unordered_map<std::string, Job> jobs;
+
+  static std::mutex queueMutex;
+  static std::condition_variable queueReady;
+  static std::deque<Pending> queue;
+  static bool stopping = false;
+  static std::vector<std::thread> workers;
+
+  static std::mutex doneMutex;
+  static std::vector<Done> done;
+
+  static std::atomic<size_t> running{0};
+  static Uint32 wakeEvent = (Uint32)-1;
+
+  static Push error(const std::string& message) {
+    return [message](lua_State* L) {
+      lua_pushnil(L);
+      lua_pushstring(L, message.c_str());
+      return 2;
+    };
+  }
+
+  static void workerLoop() {
+    for (;;) {
+      Pending job;
+      {
+        std::unique_lock<std::mutex> lock(queueMutex);
+        queueReady.wait(lock, [] { return stopping || !queue.empty(); });
+        if (stopping) return;
+        job = std::move(queue.front());
+        queue.pop_front();
+      }
+
+      Push push;
+      try {
+        push = job.work();
+      } catch (const std::exception& e) {
+        push = error(e.what());
+      }
+
+      {
+        std::lock_guard<std::mutex> lock(doneMutex);
+        done.push_back({std::move(push), std::move(job.target)});
+      }
+      running--;
+
+      // an idle main loop sleeps in SDL_WaitEventTimeout, this wakes it
+      if (wakeEvent != (Uint32)-1) {
+        SDL_Event event;
+        SDL_zero(event);
+        event.type = wakeEvent;
+        SDL_PushEvent(&event);
+      }
+    }
+  }
+
+  // workers start with the first job, apps that never submit any get no threads
+  static void startWorkers() {
+    if (!workers.empty()) return;
+
+    wakeEvent = SDL_RegisterEvents(1);
+    unsigned cores = std::thread::hardware_concurrency();
+    unsigned count = std::min(4u, std::max(1u, cores > 1 ? cores - 1 : 1));
+    for (unsigned i = 0; i < count; i++) {
+      workers.emplace_back(workerLoop);
+    }
+  }
+
+  static void submit(std::function<Push()> work, Target target) {
+    startWorkers();
+    running++;
+    {
+      std::lock_guard<std::mutex> lock(queueMutex);
+      queue.push_back({std::move(work), std::move(target)});
+    }
+    queueReady.notify_one();
+  }
+
+  void registerJob(const std::string& name, Job job) {
+    jobs[name] = std::move(job);
+  }
+
+  size_t inFlight() {
+    return running.load();
+  }
+
+  void shutdown() {
+    {
+      std::lock_guard<std::mutex> lock(queueMutex);
+      stopping = true;
+      queue.clear();
+    }
+    queueReady.notify_all();
+    for (std::thread& t : workers) t.join();
+    workers.clear();
+    done.clear();
+  }
+
+  // first result into the state store, only scalars fit there
+  static void deliverState(lua_State* L, const Done& d) {
+    int top = lua_gettop(L);
+    int count = d.push(L);
+
+    StateValue value;
+    int type = count > 0 ? lua_type(L, top + 1) : LUA_TNIL;
+    if (type == LUA_TSTRING) {
+      size_t len;
+      const char* s = lua_tolstring(L, top + 1, &len);
+      value = std::string(s, len);
+    } else if (type == LUA_TNUMBER) {
+      value = numberState(lua_tonumber(L, top + 1));
+    } else if (type == LUA_TBOOLEAN) {
+      value = (bool)lua_toboolean(L, top + 1);
+    } else {
+      const char* err = count > 1 ? lua_tostring(L, top + 2) : nullptr;
+      std::cerr << "Task Error: " << d.target.stateKey << ": "
+        << (err ? err : "result can not be stored in state") << std::endl;
+      lua_settop(L, top);
+      return;
+    }
+
+    StateManager::instance().setState(d.target.stateKey, value);
+    lua_settop(L, top);
+  }
+
+  static void resume(lua_State* L, const Done& d) {
+    lua_State* co = d.target.thread;
+    int count = d.push(co);
+    int status = resumeThread(co, L, count);
+    if (status != LUA_OK && status != LUA_YIELD) {
+      std::cerr << "Task Error: " << lua_tostring(co, -1) << std::endl;
+    }
+    luaL_unref(L, LUA_REGISTRYINDEX, d.target.threadRef);
+  }
+
+  void deliver(lua_State* L) {
+    std::vector<Done> ready;
+    {
+      std::lock_guard<std::mutex> lock(doneMutex);
+      ready.swap(done);
+    }
+
+    EngineStats& stats = EngineStats::instance();
+    stats.tasksInFlight = running.load();
+    if (ready.empty()) return;
+
+    // callbacks share one protected call, state keys are plain stores
+    Dispatch::Batch batch(L, "Task Error: ");
+    for (const Done& d : ready) {
+      if (d.target.callbackRef != LUA_NOREF) {
+        batch.add(d.target.callbackRef, d.push(L));
+        luaL_unref(L, LUA_REGISTRYINDEX, d.target.callbackRef);
+      } else if (!d.target.stateKey.empty()) {
+        deliverState(L, d);
+      }
+    }
+    batch.run();
+
+    // a resumed coroutine may submit again, so they go last
+    for (const Done& d : ready) {
+      if (d.target.thread) resume(L, d);
+    }
+
+    stats.tasksCompleted += ready.size();
+  }
+
+  static Push readFile(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return error("cannot open " + path);
+
+    std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    auto content = std::make_shared<std::string>(std::move(data));
+    return [content](lua_State* L) {
+      lua_pushlstring(L, content->data(), content->size());
+      return 1;
+    };
+  }
+
+  struct Entry {
+    std::string name;
+    uintmax_t size;
+    bool dir;
+  };
+
+  static Push scanDir(const std::string& path) {
+    std::error_code ec;
+    auto entries = std::make_shared<std::vector<Entry>>();
+    for (fs::directory_iterator it(path, ec), end; !ec && it != end; it.increment(ec)) {
+      bool dir = it->is_directory(ec);
+      uintmax_t size = dir ? 0 : it->file_size(ec);
+      entries->push_back({it->path().filename().string(), ec ? 0 : size, dir});
+      ec.clear();
+    }
+    if (ec) return error("cannot scan " + path + ": " + ec.message());
+
+    std::sort(entries->begin(), entries->end(), [](const Entry& a, const Entry& b) { return a.name < b.name; });
+    return [entries](lua_State* L) {
+      lua_createtable(L, (int)entries->size(), 0);
+      for (size_t i = 0; i < entries->size(); i++) {
+        const Entry& e = (*entries)[i];
+        lua_createtable(L, 0, 3);
+        lua_pushstring(L, e.name.c_str());
+        lua_setfield(L, -2, "name");
+        lua_pushinteger(L, (lua_Integer)e.size);
+        lua_setfield(L, -2, "size");
+        lua_pushboolean(L, e.dir);
+        lua_setfield(L, -2, "dir");
+        lua_rawseti(L, -2, (int)i + 1);
+      }
+      return 1;
+    };
+  }
+
+  // 64 bit fnv-1a of the file contents as hex
+  static Push checksum(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return error("cannot open " + path);
+
+    uint64_t hash = 1469598103934665603ull;
+    std::vector<char> buffer(64 * 1024);
+    while (in) {
+      in.read(buffer.data(), buffer.size());
+      std::streamsize got = in.gcount();
+      for (std::streamsize i = 0; i < got; i++) {
+        hash ^= (unsigned char)buffer[i];
+        hash *= 1099511628211ull;
+      }
+    }
+
+    char hex[17];
+    std::snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)hash);
+    std::string result = hex;
+    return [result](lua_State* L) {
+      lua_pushstring(L, result.c_str());
+      return 1;
+    };
+  }
+
+  enum class Submitted {
+    Queued,
+    Yield,
+    NoTarget
+  };
+
+  // done at idx: callback, state key, or nothing inside a coroutine to yield it
+  static Submitted submitFrom(lua_State* L, int idx, std::function<Push()> work) {
+    Target target;
+
+    if (lua_isfunction(L, idx)) {
+      lua_pushvalue(L, idx);
+      target.callbackRef = luaL_ref(L, LUA_REGISTRYINDEX);
+    } else if (lua_type(L, idx) == LUA_TSTRING) {
+      target.stateKey = lua_tostring(L, idx);
+    } else {
+      if (lua_pushthread(L)) {
+        lua_pop(L, 1);
+        return Submitted::NoTarget;
+      }
+      target.thread = L;
+      target.threadRef = luaL_ref(L, LUA_REGISTRYINDEX);
+      submit(std::move(work), std::move(target));
+      return Submitted::Yield;
+    }
+
+    submit(std::move(work), std::move(target));
+    return Submitted::Queued;
+  }
+
+  // yielding and raising both unwind past the caller, so they happen only
+  // once its c++ locals are gone
+  static int finish(lua_State* L, Submitted result) {
+    if (result == Submitted::Yield) return lua_yield(L, 0);
+    if (result == Submitted::NoTarget) {
+      return luaL_error(L, "task needs a callback, a state key, or to be called from a coroutine");
+    }
+    return 0;
+  }
+}
+
+using namespace Tasks;
+
+int l_readFile(lua_State* L) {
+  Submitted result = submitFrom(L, 2, [path = std::string(luaL_checkstring(L, 1))] { return readFile(path); });
+  return finish(L, result);
+}
+
+int l_scanDir(lua_State* L) {
+  Submitted result = submitFrom(L, 2, [path = std::string(luaL_checkstring(L, 1))] { return scanDir(path); });
+  return finish(L, result);
+}
+
+int l_checksum(lua_State* L) {
+  Submitted result = submitFrom(L, 2, [path = std::string(luaL_checkstring(L, 1))] { return checksum(path); });
+  return finish(L, result);
+}
+
+int l_runJob(lua_State* L) {
+  const char* name = luaL_checkstring(L, 1);
+  auto it = jobs.find(name);
+  if (it == jobs.end()) {
+    return luaL_error(L, "no task registered as '%s'", name);
+  }
+
+  Submitted result = submitFrom(L, 3, [job = it->second, arg = std::string(luaL_optstring(L, 2, ""))] {
+    return job(arg);
+  });
+  return finish(L, result);
+}
+
+int l_pending(lua_State* L) {
+  lua_pushinteger(L, (lua_Integer)inFlight());
+  return 1;
+}
+
+void registerTaskBindings(lua_State* L) {
+  pushVulpisTable(L);
+  lua_newtable(L);
+
+  lua_pushcfunction(L, l_readFile);
+  lua_setfield(L, -2, "readFile");
+  lua_pushcfunction(L, l_scanDir);
+  lua_setfield(L, -2, "scanDir");
+  lua_pushcfunction(L, l_checksum);
+  lua_setfield(L, -2, "checksum");
+  lua_pushcfunction(L, l_runJob);
+  lua_setfield(L, -2, "run");
+  lua_pushcfunction(L, l_pending);
+  lua_setfield(L, -2, "pending");
+
+  lua_setfield(L, -2, "task");
+  lua_pop(L, 1);
+}
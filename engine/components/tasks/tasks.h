@@ -0,0 +1,28 @@
+#pragma once
+#include <functional>
+#include <string>
+#include "../../lua.hpp"
+
+// background work on an engine thread pool. Jobs run off the main thread and
+// must not touch lua, what they hand back is pushed on the main thread
+namespace Tasks {
+  // pushes a finished job's results, returns how many
+  using Push = std::function<int(lua_State* L)>;
+  using Job = std::function<Push(const std::string& arg)>;
+
+  // makes a job callable as vulpis.task.run(name, arg, done)
+  void registerJob(const std::string& name, Job job);
+
+  // hands finished jobs to their callbacks, state keys or coroutines. Runs
+  // once per frame on the main thread, before reconcile
+  void deliver(lua_State* L);
+
+  // queued or running jobs
+  size_t inFlight();
+
+  // stops the workers, jobs still queued are dropped
+  void shutdown();
+}
+
+// registers vulpis.task.{readFile, scanDir, checksum, run, pending}
+void registerTaskBindings(lua_State* L);
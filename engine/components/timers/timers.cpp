@@ -0,0 +1,304 @@
+#include "timers.h"
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#include "../dispatch/dispatch.h"
+#include "../stats/stats.h"
+
+namespace Timers {
+
+  // 4 levels of 64 slots at 1 ms per tick covers about 4.6 hours, later
+  // timers sit in the last slot and are placed again when it cascades
+  static const int LEVELS = 4;
+  static const int SLOT_BITS = 6;
+  static const int SLOTS = 1 << SLOT_BITS;
+  static const uint64_t SLOT_MASK = SLOTS - 1;
+  static const uint64_t RANGE = 1ull << (SLOT_BITS * LEVELS);
+
+  // ids carry the pool index in the low bits and a generation above them,
+  // so a stale id can not cancel a timer that reused its entry
+  static const uint64_t INDEX_BITS = 24;
+  static const uint64_t INDEX_MASK = (1ull << INDEX_BITS) - 1;
+
+  struct Timer {
+    uint64_t expires = 0;
+    uint64_t interval = 0;
+    int ref = LUA_NOREF;
+    uint32_t generation = 0;
+    // slot list links, level -1 while not in the wheel
+    int prev = -1;
+    int next = -1;
+    int level = -1;
+    int slot = 0;
+  };
+
+  static std::vector<Timer> pool;
+  static std::vector<int> freeList;
+  static int heads[LEVELS][SLOTS];
+  static uint64_t occupied[LEVELS];
+  static uint64_t current = 0;
+  static double baseMs = -1;
+  static size_t count = 0;
+
+  static int lowestBit(uint64_t bits) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, bits);
+    return (int)index;
+#else
+    return __builtin_ctzll(bits);
+#endif
+  }
+
+  static void init(double now) {
+    if (baseMs >= 0) return;
+    baseMs = now;
+    for (int level = 0; level < LEVELS; level++) {
+      for (int slot = 0; slot < SLOTS; slot++) heads[level][slot] = -1;
+    }
+  }
+
+  static uint64_t toTicks(double now) {
+    return now > baseMs ? (uint64_t)(now - baseMs) : 0;
+  }
+
+  static void link(int index) {
+    Timer& t = pool[index];
+    uint64_t delta = t.expires - current;
+    uint64_t at = delta < RANGE ? t.expires : current + RANGE - 1;
+
+    int level = 0;
+    while (level < LEVELS - 1 && (at - current) >= (1ull << (SLOT_BITS * (level + 1)))) level++;
+    int slot = (int)((at >> (SLOT_BITS * level)) & SLOT_MASK);
+
+    t.prev = -1;
+    t.next = heads[level][slot];
+    if (t.next != -1) pool[t.next].prev = index;
+    heads[level][slot] = index;
+    occupied[level] |= 1ull << slot;
+    t.level = level;
+    t.slot = slot;
+  }
+
+  static void unlink(int index) {
+    Timer& t = pool[index];
+    if (t.prev != -1) {
+      pool[t.prev].next = t.next;
+    } else {
+      heads[t.level][t.slot] = t.next;
+      if (t.next == -1) occupied[t.level] &= ~(1ull << t.slot);
+    }
+    if (t.next != -1) pool[t.next].prev = t.prev;
+    t.prev = t.next = -1;
+    t.level = -1;
+  }
+
+  static void release(lua_State* L, int index) {
+    Timer& t = pool[index];
+    luaL_unref(L, LUA_REGISTRYINDEX, t.ref);
+    t.ref = LUA_NOREF;
+    t.generation++;
+    freeList.push_back(index);
+    count--;
+  }
+
+  double add(lua_State* L, int ref, double delayMs, bool repeat) {
+    double now = clockMs();
+    init(now);
+
+    // catch up first so the delay counts from now, not from the last tick
+    uint64_t ticks = toTicks(now);
+    if (ticks > current && count == 0) current = ticks;
+
+    int index;
+    if (!freeList.empty()) {
+      index = freeList.back();
+      freeList.pop_back();
+    } else {
+      if (pool.size() > INDEX_MASK) {
+        luaL_unref(L, LUA_REGISTRYINDEX, ref);
+        return 0;
+      }
+      index = (int)pool.size();
+      pool.emplace_back();
+    }
+
+    // at least one tick, a zero delay still waits for the next frame
+    uint64_t delay = delayMs >= 1 ? (uint64_t)delayMs : 1;
+    Timer& t = pool[index];
+    t.ref = ref;
+    t.interval = repeat ? delay : 0;
+    t.expires = std::max(ticks, current) + delay;
+    link(index);
+    count++;
+
+    // 0 stays free to mean no timer
+    return (double)((((uint64_t)t.generation << INDEX_BITS) | (uint64_t)index) + 1);
+  }
+
+  void cancel(lua_State* L, double id) {
+    if (id < 1) return;
+    uint64_t raw = (uint64_t)id - 1;
+    size_t index = (size_t)(raw & INDEX_MASK);
+    if (index >= pool.size()) return;
+
+    Timer& t = pool[index];
+    if (t.generation != (uint32_t)(raw >> INDEX_BITS) || t.ref == LUA_NOREF) return;
+
+    if (t.level != -1) unlink((int)index);
+    release(L, (int)index);
+  }
+
+  // moves every timer of one slot down to where it now belongs
+  static void cascade(int level, int slot) {
+    int index = heads[level][slot];
+    heads[level][slot] = -1;
+    occupied[level] &= ~(1ull << slot);
+
+    while (index != -1) {
+      int next = pool[index].next;
+      link(index);
+      index = next;
+    }
+  }
+
+  // timers in one slot, detached from the wheel
+  static void collect(int slot, std::vector<int>& due) {
+    int index = heads[0][slot];
+    heads[0][slot] = -1;
+    occupied[0] &= ~(1ull << slot);
+
+    while (index != -1) {
+      Timer& t = pool[index];
+      int next = t.next;
+      t.prev = t.next = -1;
+      t.level = -1;
+      due.push_back(index);
+      index = next;
+    }
+  }
+
+  void tick(lua_State* L, double now) {
+    if (baseMs < 0) return;
+    uint64_t target = toTicks(now);
+
+    static std::vector<int> due;
+    due.clear();
+
+    while (current < target) {
+      if (count == 0) {
+        current = target;
+        break;
+      }
+
+      // nothing on the lowest level, skip straight to where the next cascade is
+      if (!occupied[0]) {
+        current = std::min(current | SLOT_MASK, target);
+        if (current == target) break;
+      }
+
+      current++;
+      int slot = (int)(current & SLOT_MASK);
+      // each time a level wraps, the next slot of the level above comes down
+      for (int level = 1; level < LEVELS && ((current >> (SLOT_BITS * level - SLOT_BITS)) & SLOT_MASK) == 0; level++) {
+        cascade(level, (int)((current >> (SLOT_BITS * level)) & SLOT_MASK));
+      }
+      if (occupied[0] & (1ull << slot)) collect(slot, due);
+    }
+
+    EngineStats& stats = EngineStats::instance();
+    if (due.empty()) {
+      stats.timersActive = count;
+      return;
+    }
+
+    Dispatch::Batch batch(L, "Timer Error: ");
+    for (int index : due) {
+      Timer& t = pool[index];
+      batch.add(t.ref, 0);
+
+      // intervals keep their phase unless the loop fell a whole period behind
+      if (t.interval > 0) {
+        t.expires = std::max(t.expires + t.interval, current + 1);
+        link(index);
+      } else {
+        release(L, index);
+      }
+    }
+    batch.run();
+
+    stats.timersFired += due.size();
+    stats.timersActive = count;
+  }
+
+  double nextDeadline(double now) {
+    if (count == 0 || baseMs < 0) return -1;
+
+    // nearest occupied slot on every level, higher levels only up to the
+    // tick where that slot cascades
+    uint64_t best = UINT64_MAX;
+    for (int level = 0; level < LEVELS; level++) {
+      uint64_t bits = occupied[level];
+      if (!bits) continue;
+
+      int shift = SLOT_BITS * level;
+      int at = (int)((current >> shift) & SLOT_MASK);
+      // rotate so bit 0 is the slot right after the current one
+      int rot = (at + 1) & (int)SLOT_MASK;
+      uint64_t rotated = rot ? (bits >> rot) | (bits << (SLOTS - rot)) : bits;
+      uint64_t distance = (uint64_t)lowestBit(rotated) + 1;
+
+      uint64_t when = ((current >> shift) + distance) << shift;
+      if (when < best) best = when;
+    }
+
+    double ms = (double)best - (now - baseMs);
+    return ms > 0 ? ms : 0;
+  }
+
+  size_t active() {
+    return count;
+  }
+}
+
+static int schedule(lua_State* L, bool repeat) {
+  luaL_checktype(L, 1, LUA_TFUNCTION);
+  double delay = luaL_optnumber(L, 2, 0);
+
+  lua_pushvalue(L, 1);
+  int ref = luaL_ref(L, LUA_REGISTRYINDEX);
+  double id = Timers::add(L, ref, delay, repeat);
+  if (id == 0) return luaL_error(L, "too many timers");
+
+  lua_pushnumber(L, id);
+  return 1;
+}
+
+int l_setTimeout(lua_State* L) {
+  return schedule(L, false);
+}
+
+int l_setInterval(lua_State* L) {
+  return schedule(L, true);
+}
+
+int l_clearTimer(lua_State* L) {
+  if (lua_isnumber(L, 1)) Timers::cancel(L, lua_tonumber(L, 1));
+  return 0;
+}
+
+void registerTimerBindings(lua_State* L) {
+  pushVulpisTable(L);
+  lua_pushcfunction(L, l_setTimeout);
+  lua_setfield(L, -2, "setTimeout");
+  lua_pushcfunction(L, l_setInterval);
+  lua_setfield(L, -2, "setInterval");
+  lua_pushcfunction(L, l_clearTimer);
+  lua_setfield(L, -2, "clearTimeout");
+  lua_pushcfunction(L, l_clearTimer);
+  lua_setfield(L, -2, "clearInterval");
+  lua_pop(L, 1);
+}
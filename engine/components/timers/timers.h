@@ -0,0 +1,25 @@
+#pragma once
+#include "../../lua.hpp"
+
+// setTimeout / setInterval on a hierarchical timer wheel. Inserting and
+// cancelling are O(1), due callbacks of a frame fire through one lua_pcall
+namespace Timers {
+  // schedules the function registry ref `ref` to run after delayMs, and every
+  // delayMs after that when repeat is set. The ref is owned by the timer from here
+  double add(lua_State* L, int ref, double delayMs, bool repeat);
+
+  // removes a pending timer, ids that already fired or were cleared are ignored
+  void cancel(lua_State* L, double id);
+
+  // advances the wheel to `now` and runs everything that came due
+  void tick(lua_State* L, double now);
+
+  // ms from `now` until the wheel needs to be ticked again, -1 with no timers.
+  // Timers far out only wake the loop to move down a level, never late
+  double nextDeadline(double now);
+
+  size_t active();
+}
+
+// registers vulpis.setTimeout, setInterval, clearTimeout and clearInterval
+void registerTimerBindings(lua_State* L);
@@ -7,16 +7,26 @@
 #include <string>
 #include "../color/color.h"
 #include "../vdom/vdom.h"
-
-
-Align parseAlign(std::string s) {
+#include "../native/native.h"
+#include "../layers/layers.h"
+#include "../style/style.h"
+#include "../animation/animation.h"
+#include "../input/input.h"
+#include "../memory/memory.h"
+#include "../render/render.h"
+#include "../decor/decor.h"
+#include "../layout/layout.h"
+#include "../refs/refs.h"
+
+
+Align parseAlign(std::string_view s) {
     if (s == "center") return Align::Center;
     if (s == "end") return Align::End;
     if (s == "stretch") return Align::Stretch;
     return Align::Start;
 }
 
-Justify parseJustify(std::string s) {
+Justify parseJustify(std::string_view s) {
     if (s == "center") return Justify::Center;
     if (s == "end") return Justify::End;
     if (s == "space-around") return Justify::SpaceAround;
@@ -25,284 +35,248 @@ Justify parseJustify(std::string s) {
     return Justify::Start;
 }
 
-Length getLength(lua_State* L, const char* key) {
-    Length len;
-    lua_getfield(L, -1, key);
+// one element without its children, natively built elements come with theirs
+static Node* buildElement(lua_State* L, int idx, bool& complete) {
+    luaL_checktype(L, idx, LUA_TTABLE);
 
-    if (lua_isnumber(L, -1)) {
-        len.value = (float)lua_tonumber(L, -1);
-        len.type = PIXEL;
+    // subtree was already built through the ffi, only callbacks live in the table
+    Node* n = Native::adopt(Native::handleAt(L, idx));
+    complete = n != nullptr;
+    if (n) {
+        VDOM::updateCallbacks(L, idx, n);
+        return n;
     }
-    else if (lua_isstring(L, -1)) {
-        std::string s = lua_tostring(L, -1);
-        if (!s.empty() && s.back() == '%') {
-            try {
-                float val = std::stof(s.substr(0, s.size() - 1));
-                len = Length::Percent(val);
-            } catch (...) {
-                len = Length(0);
-            }
-        } else {
-             len = Length(0);
-        }
-    }
-    
-    lua_pop(L, 1);
-    return len;
-}
-
 
-
-Node* buildNode(lua_State* L, int idx) {
-    luaL_checktype(L, idx, LUA_TTABLE);
-
-    Node* n = new Node();
+    n = new Node();
 
     lua_getfield(L, idx, "type");
     if (lua_isstring(L, -1))
         n->type = lua_tostring(L, -1);
     lua_pop(L, 1);
 
+    // reconcile matches keyed children against this on the next pass
+    lua_getfield(L, idx, "key");
+    if (lua_isstring(L, -1)) {
+        size_t len = 0;
+        const char* key = lua_tolstring(L, -1, &len);
+        Refs::setKey(n, std::string_view(key, len));
+    }
+    lua_pop(L, 1);
+
     lua_getfield(L, idx, "style");
-    bool hasStyle = lua_istable(L, -1);
-
-    auto getInt = [&](const char* key, int defaultVal) {
-        int val = defaultVal;
-        if (hasStyle) {
-            lua_getfield(L, -1, key);
-            if (lua_isnumber(L, -1))
-                val = lua_tointeger(L, -1);
-            lua_pop(L, 1);
-        }
-        return val;
-    };
+    Style::apply(L, n, lua_gettop(L));
+    lua_pop(L, 1);
 
-    auto getFloat = [&](const char* key, float defaultVal) {
-      float val = defaultVal;
-      if (hasStyle) {
-        lua_getfield(L, -1, key);
-        if (lua_isnumber(L, -1)) val = (float)lua_tonumber(L, -1);
-        lua_pop(L, 1);
-      }
-      return val;
-    };
+    VDOM::updateCallbacks(L, idx, n);
+    return n;
+}
 
-    auto getString = [&](const char* key, std::string defaultVal) {
-      std::string val = defaultVal;
-      if (hasStyle) {
-        lua_getfield(L, -1, key);
-        if (lua_isstring(L, -1)) val = lua_tostring(L, -1);
-        lua_pop(L, 1);
-      }
-      return val;
-    };
+struct BuildFrame {
+    Node* node;
+    int count;
+    int next;
+};
 
-    if (hasStyle) {
-        n->widthStyle = getLength(L, "w");
-        n->heightStyle = getLength(L, "h");
-    }
+// depth first without recursing, the children table of every open level is
+// parked in a scratch table so the lua stack stays the same size at any depth
+Node* buildNode(lua_State* L, int idx) {
+    luaL_checkstack(L, 8, "building element tree");
+    int top = lua_gettop(L);
+    if (idx < 0 && idx > LUA_REGISTRYINDEX) idx = top + idx + 1;
 
-    n->spacing = getInt("gap", getInt("spacing", 0));
-
-    int p = getInt("padding", 0);
-    n->padding       = p;
-    n->paddingTop    = getInt("paddingTop", p);
-    n->paddingBottom = getInt("paddingBottom", p);
-    n->paddingLeft   = getInt("paddingLeft", p);
-    n->paddingRight  = getInt("paddingRight", p);
-
-    int m = getInt("margin", 0);
-    n->margin       = m;
-    n->marginTop    = getInt("marginTop", m);
-    n->marginBottom = getInt("marginBottom", m);
-    n->marginLeft   = getInt("marginLeft", m);
-    n->marginRight  = getInt("marginRight", m);
-
-    n->minHeight = getInt("minHeight", 0);
-    n->maxHeight = getInt("maxHeight", 99999);
-    n->minWidth = getInt("minWidth", 0);
-    n->maxWidth = getInt("maxWidth", 99999);
-
-    n->flexGrow = getFloat("flexGrow", 0.0f);
-    n->alignItems = parseAlign(getString("alignItems", "start"));
-    n->justifyContent = parseJustify(getString("justifyContent", "start"));
-
-    if (hasStyle) {
-        lua_getfield(L, -1, "BGColor");
-        if (lua_isstring(L, -1)) {
-          const char* hex = lua_tostring(L, -1);
-          n->color = parseHexColor(hex);
-          n->hasBackground = true;
-        }
-        else if (lua_istable(L, -1)) {
-            lua_rawgeti(L, -1, 1); n->color.r = luaL_optinteger(L, -1, 255); lua_pop(L, 1);
-            lua_rawgeti(L, -1, 2); n->color.g = luaL_optinteger(L, -1, 255); lua_pop(L, 1);
-            lua_rawgeti(L, -1, 3); n->color.b = luaL_optinteger(L, -1, 255); lua_pop(L, 1);
-            lua_rawgeti(L, -1, 4); n->color.a = luaL_optinteger(L, -1, 255); lua_pop(L, 1);
+    bool complete;
+    Node* root = buildElement(L, idx, complete);
+    if (complete) return root;
 
-            n->hasBackground = true;
-        }
-        lua_pop(L, 1);
+    lua_getfield(L, idx, "children");
+    if (!lua_istable(L, -1)) {
+        lua_settop(L, top);
+        return root;
     }
 
-    lua_pop(L, 1);
-
-    lua_getfield(L, idx, "onClick");
-    if (lua_isfunction(L, -1)) {
-        n->onClickRef = luaL_ref(L, LUA_REGISTRYINDEX);
-    } else {
-        lua_pop(L, 1);
-    }
+    static std::vector<BuildFrame> frames;
+    frames.clear();
+
+    lua_newtable(L);
+    int levels = lua_gettop(L);
+    lua_pushvalue(L, -2);
+    lua_rawseti(L, levels, 1);
+    frames.push_back({root, (int)lua_rawlen(L, -2), 0});
+
+    while (!frames.empty()) {
+        size_t depth = frames.size();
+        BuildFrame& frame = frames.back();
+        if (frame.next == frame.count) {
+            frames.pop_back();
+            continue;
+        }
 
-    VDOM::updateCallback(L, idx, "onClick", n->onClickRef);
-    lua_getfield(L, idx, "children");
-    if (lua_istable(L, -1)) {
-        lua_pushnil(L);
-        while (lua_next(L, -2) != 0) {
-            Node* child = buildNode(L, lua_gettop(L));
-            child->parent = n;
-            n->children.push_back(child);
-            lua_pop(L, 1);
+        Node* parent = frame.node;
+        lua_rawgeti(L, levels, (int)depth);
+        lua_rawgeti(L, -1, ++frame.next);
+        int elementIdx = lua_gettop(L);
+
+        Node* child = buildElement(L, elementIdx, complete);
+        child->parent = parent;
+        parent->children.push_back(child);
+
+        if (!complete) {
+            lua_getfield(L, elementIdx, "children");
+            int count = lua_istable(L, -1) ? (int)lua_rawlen(L, -1) : 0;
+            if (count > 0) {
+                lua_rawseti(L, levels, (int)depth + 1);
+                frames.push_back({child, count, 0});
+            }
         }
+        lua_settop(L, levels);
     }
-    lua_pop(L, 1);
 
-    return n;
+    lua_settop(L, top);
+    return root;
 }
 
-void resolveStyles(Node* n, int parentW, int parentH) {
-    if (!n) return;
+// auto sizes start from zero, anything left from the last solve would stick
+static void resolveSize(Node* n, int parentW, int parentH) {
+    n->w = n->widthStyle.value != 0 ? n->widthStyle.resolve((float)parentW) : 0;
+    n->h = n->heightStyle.value != 0 ? n->heightStyle.resolve((float)parentH) : 0;
+}
 
-    if (n->widthStyle.value != 0) {
-        n->w = n->widthStyle.resolve((float)parentW);
-    }
+// a parent sizes its children before they are visited, so only nodes with
+// children of their own go on the stack
+void resolveStyles(Node* root, int rootParentW, int rootParentH) {
+    if (!root) return;
 
-    if (n->heightStyle.value != 0) {
-        n->h = n->heightStyle.resolve((float)parentH);
-    }
+    resolveSize(root, rootParentW, rootParentH);
 
-    int contentW = (int)n->w - (n->paddingLeft + n->paddingRight);
-    int contentH = (int)n->h - (n->paddingTop + n->paddingBottom);
-    
-    if (contentW < 0) contentW = 0;
-    if (contentH < 0) contentH = 0;
+    std::vector<Node*>& stack = walkStack();
+    size_t base = stack.size();
+    stack.push_back(root);
 
-    for (Node* c : n->children) {
-        resolveStyles(c, contentW, contentH);
-    }
-}
+    while (stack.size() > base) {
+        Node* n = stack.back();
+        stack.pop_back();
+        if (n->displayNone) continue;
 
-void measure(Node* n) {
-  if (n->type == "vbox") {
-    int totalH = 0;
-    int maxW = 0;
+        int contentW = (int)n->w - (n->paddingLeft + n->paddingRight);
+        int contentH = (int)n->h - (n->paddingTop + n->paddingBottom);
 
-    for (Node* c : n->children) {
-      measure(c);
+        if (contentW < 0) contentW = 0;
+        if (contentH < 0) contentH = 0;
 
-      int childH = (int)c->h + c->marginBottom + c->marginTop;
-      int childW = (int)c->w + c->marginLeft + c->marginRight;
-
-      totalH += childH + n->spacing;
-      maxW = std::max(maxW, childW);
+        for (size_t i = n->children.size(); i-- > 0;) {
+            Node* c = n->children[i];
+            resolveSize(c, contentW, contentH);
+            if (!c->children.empty()) stack.push_back(c);
+        }
     }
+}
 
-    if (!n->children.empty()) {
-      totalH -= n->spacing;
+// a node to draw, or with restore set the clip to put back once its children are done
+struct DrawFrame {
+    Node* node;
+    bool restore;
+    SDL_Rect clip;
+};
+
+// offsetX/Y move the subtree into layer texture space, layerRoot is the
+// node currently being drawn into its own layer. Layers are filled from
+// inside a draw, so a nested call only works on the stack above its own base
+static void drawNode(Render::RenderBackend& b, Node* root, float offsetX, float offsetY, Node* layerRoot) {
+  static std::vector<DrawFrame> stack;
+  size_t base = stack.size();
+  stack.push_back({root, false, {}});
+
+  while (stack.size() > base) {
+    DrawFrame f = stack.back();
+    stack.pop_back();
+    if (f.restore) {
+      b.setClip(f.clip);
+      continue;
     }
 
-    if (n->w == 0) n->w = maxW + n->paddingLeft + n->paddingRight;
-    if (n->h == 0) n->h = totalH + n->paddingTop + n->paddingBottom;
-  }
-  else if (n->type == "hbox") {
-    int totalW = 0;
-    int maxH = 0;
+    Node* n = f.node;
+    if (n->displayNone) continue;
 
-    for (Node* c : n->children) {
-      measure(c);
+    SDL_Rect nodeBox = {
+      (int)(n->x - offsetX),
+      (int)(n->y - offsetY),
+      (int)n->w,
+      (int)n->h,
+    };
 
-      int childH = (int)c->h + c->marginTop + c->marginBottom;
-      int childW = (int)c->w + c->marginLeft + c->marginRight;
+    SDL_Rect oldClip = b.clip();
 
-      totalW += childW + n->spacing;
-      maxH = std::max(maxH, childH);
-    }
+    n->isPaintDirty = false;
 
-    if (!n->children.empty()) {
-      totalW -= n->spacing;
+    if (!n->isLayer && n->layerTexture) {
+      Layers::release(n);
     }
 
-    if (n->w == 0) n->w = totalW + n->paddingRight + n->paddingLeft;
-    if (n->h == 0) n->h = maxH + n->paddingTop + n->paddingBottom;
-  }
-}
+    if (n->isLayer && n != layerRoot && b.drawLayer(n, nodeBox)) {
+      continue;
+    }
 
-void layout(Node* n, int x, int y) {
-  n->x = (float)x;
-  n->y = (float)y;
+    if (Decor::needed(n)) {
+      Decor::draw(b, n, n->x - offsetX, n->y - offsetY);
+    } else if (n->hasBackground) {
+      b.fillRect(nodeBox, n->color);
+    }
 
-  if (n->type == "vbox") {
-    int cursor = y + n->paddingTop;
+    if (n->children.empty()) continue;
 
-    for (Node* c : n->children) {
-      int cx = x + n->paddingLeft + c->marginLeft;
-      int cy = cursor + c->marginTop;
+    // leaves, clipped away nodes and nodes that do not narrow the clip leave
+    // it alone, so only a node that changes it needs a frame to put it back
+    SDL_Rect newClip;
+    bool isVisible = SDL_IntersectRect(&oldClip, &nodeBox, &newClip);
 
-      layout(c, cx, cy);
-      cursor += (int)c->h + n->spacing + c->marginTop + c->marginBottom;
-    }
-  }
-  else if (n->type == "hbox") {
-    int cursor = x + n->paddingLeft; 
-
-    for (Node* c : n->children) {
-      int cx = cursor + c->marginLeft;
-      int cy = y + n->paddingTop + c->marginTop;
+    if (isVisible) {
+      if (!SDL_RectEquals(&newClip, &oldClip)) {
+        stack.push_back({n, true, oldClip});
+        b.setClip(newClip);
+      }
 
-      layout(c, cx, cy);
-      cursor += (int)c->w + n->spacing + c->marginRight + c->marginLeft;
+      for (size_t i = n->children.size(); i-- > 0;) {
+        stack.push_back({n->children[i], false, {}});
+      }
     }
   }
 }
 
-void renderNode(SDL_Renderer* r, Node* n) {
-
-  SDL_Rect nodeBox = {
-    (int)n->x,
-    (int)n->y,
-    (int)n->w,
-    (int)n->h,
-  };
-
-  if (n->hasBackground) {
-    SDL_SetRenderDrawColor(r, n->color.r, n->color.g, n->color.b, n->color.a);
-    SDL_RenderFillRect(r, &nodeBox);
-  }
+void renderNode(Render::RenderBackend& b, Node* n) {
+  drawNode(b, n, 0, 0, nullptr);
+}
 
-  SDL_Rect oldClip;
-  SDL_RenderGetClipRect(r, &oldClip);
+void renderLayerContents(SDL_Renderer* r, Node* n) {
+  Render::SdlBackend b(r);
+  drawNode(b, n, n->x, n->y, n);
+}
 
-  if (!SDL_RenderIsClipEnabled(r)) {
-    SDL_RenderGetViewport(r, &oldClip);
-  }
+static void releaseNode(Node* n) {
+  Layers::release(n);
+  Decor::release(n);
+  Layout::release(n);
+  Animation::cancel(n);
+  Input::forget(n);
+  Refs::remove(n);
+  Memory::release(n->onClickRef);
+  Memory::release(n->onHoverRef);
+  Memory::release(n->onPointerMoveRef);
+  Memory::release(n->onWheelRef);
+  delete n;
+}
 
-  SDL_Rect newClip;
-  bool isVisible = SDL_IntersectRect(&oldClip, &nodeBox, &newClip);
+// parents go before their children, nothing in here looks at the tree
+void freeTree(Node* root) {
+  if (!root) return;
 
-  if (isVisible) {
-    SDL_RenderSetClipRect(r, &newClip);
+  std::vector<Node*>& stack = walkStack();
+  size_t base = stack.size();
+  stack.push_back(root);
 
-    for (Node* c : n->children) {
-      renderNode(r, c);
-    }
+  while (stack.size() > base) {
+    Node* n = stack.back();
+    stack.pop_back();
+    stack.insert(stack.end(), n->children.begin(), n->children.end());
+    releaseNode(n);
   }
-
-  SDL_RenderSetClipRect(r, &oldClip);
-  
-}
-
-void freeTree(Node* n) {
-  for (Node* c : n->children)
-    freeTree(c);
-  delete n;
 }
@@ -1,5 +1,6 @@
 #pragma once
 #include <string>
+#include <string_view>
 #include <vector>
 #include <SDL2/SDL.h>
 
@@ -8,11 +9,7 @@ enum UnitType {
   PERCENT,
 };
 
-extern "C" {
-#include <lua.h>
-#include <lauxlib.h>
-#include <lualib.h>
-}
+#include "../../lua.hpp"
 
 enum class Justify {
   Start,
@@ -55,9 +52,59 @@ inline Length pct(float v) {
   return Length::Percent(v);
 }
 
+enum class Easing {
+  Linear,
+  EaseIn,
+  EaseOut,
+  EaseInOut
+};
+
+// one entry of style.transition, e.g. transition = { BGColor = 200 }
+struct TransitionSpec {
+  std::string property;
+  float durationMs = 0;
+  Easing easing = Easing::EaseInOut;
+  bool spring = false;
+  float stiffness = 170.0f;
+  float damping = 26.0f;
+
+  bool operator==(const TransitionSpec& o) const {
+    return property == o.property && durationMs == o.durationMs && easing == o.easing &&
+      spring == o.spring && stiffness == o.stiffness && damping == o.damping;
+  }
+};
+
+// style.boxShadow = { x, y, blur, spread, color }
+struct BoxShadow {
+  bool enabled = false;
+  float x = 0, y = 0;
+  float blur = 0, spread = 0;
+  SDL_Color color = {0, 0, 0, 0};
+
+  bool operator==(const BoxShadow& o) const {
+    return enabled == o.enabled && x == o.x && y == o.y && blur == o.blur && spread == o.spread &&
+      color.r == o.color.r && color.g == o.color.g && color.b == o.color.b && color.a == o.color.a;
+  }
+};
+
+namespace Decor { struct Mesh; }
+struct YGNode;
+
 struct Node {
+  // live count for memory accounting, and every node ever built
+  static inline size_t liveCount = 0;
+  static inline size_t createdCount = 0;
+
+  Node() { liveCount++; createdCount++; }
+  ~Node() { liveCount--; }
+  Node(const Node&) = delete;
+  Node& operator=(const Node&) = delete;
+
   std::string type;
   std::string key;
+  // other live nodes with the same key, see Refs
+  Node* keyPrev = nullptr;
+  Node* keyNext = nullptr;
   std::vector<Node*> children;
 
 
@@ -81,37 +128,94 @@ struct Node {
   Justify justifyContent = Justify::Start;
 
   int onClickRef = -2;
+  int onHoverRef = -2;
+  int onPointerMoveRef = -2;
+  int onWheelRef = -2;
   Node* hitTest(Node* root, int x, int y);
 
   SDL_Color color = {0,0,0,0};
   bool hasBackground = false;
 
+  // drawn inside the box, they do not take part in layout
+  float borderRadius = 0;
+  int borderWidth = 0;
+  SDL_Color borderColor = {0,0,0,255};
+  BoxShadow shadow;
+  // cached triangles for the above, see Decor
+  Decor::Mesh* mesh = nullptr;
+
+  // style.layer, the subtree is cached in its own texture
+  bool isLayer = false;
+  bool isLayerDirty = true;
+  SDL_Texture* layerTexture = nullptr;
+  int layerW = 0, layerH = 0;
+
+  // style.display = "none", the subtree is kept alive but not laid out,
+  // drawn, hit or reconciled until it is shown again
+  bool displayNone = false;
+
+  std::vector<TransitionSpec> transitions;
+  bool isAnimating = false;
+
+  // set by the solver, the size follows the viewport through every ancestor
+  bool viewportDependent = false;
+  // kept across solves by the yoga solver, see Layout::release
+  YGNode* yoga = nullptr;
+
   Node* parent = nullptr;
   bool isLayoutDirty = true;
   bool isPaintDirty = true;
 
   void makeLayoutDirty() {
-    isLayoutDirty = true;
-    if (parent) {
-      parent->makeLayoutDirty();
+    for (Node* n = this; n; n = n->parent) {
+      n->isLayoutDirty = true;
+      n->isLayerDirty = true;
     }
   }
 
+  // paint only changes never reach the layout solver
   void makePaintDirty() {
-    isLayoutDirty = true;
-    if (parent) {
-      parent->makeLayoutDirty();
+    for (Node* n = this; n; n = n->parent) {
+      n->isPaintDirty = true;
+      n->isLayerDirty = true;
     }
   }
 
 };
 
+// shared scratch for walkTree, nested walks only use the part above their own
+inline std::vector<Node*>& walkStack() {
+  static std::vector<Node*> stack;
+  return stack;
+}
+
+// visits root and its subtree parents first and in child order, without
+// recursing so any depth is safe. Children are skipped when visit returns false
+template <typename Visit>
+void walkTree(Node* root, Visit&& visit) {
+  std::vector<Node*>& stack = walkStack();
+  size_t base = stack.size();
+  stack.push_back(root);
+
+  while (stack.size() > base) {
+    Node* n = stack.back();
+    stack.pop_back();
+    if (!visit(n)) continue;
+    for (size_t i = n->children.size(); i-- > 0;) {
+      stack.push_back(n->children[i]);
+    }
+  }
+}
+
+
+namespace Render { class RenderBackend; }
 
 Node* buildNode(lua_State* L, int idx);
-void renderNode(SDL_Renderer* r, Node* n);
+void renderNode(Render::RenderBackend& b, Node* n);
+// draws n and its subtree with n at the origin, used to fill layer textures
+void renderLayerContents(SDL_Renderer* r, Node* n);
 void freeTree(Node* n);
 void resolveStyles(Node* n, int parentW, int parentH);
 void reconcile(lua_State* L, Node* current, int idx);
-Length getLength(lua_State* L, const char* key);
-Align parseAlign(std::string s);
-Justify parseJustify(std::string s);
+Align parseAlign(std::string_view s);
+Justify parseJustify(std::string_view s);
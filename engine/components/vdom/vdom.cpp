@@ -1,219 +1,222 @@
 #include "vdom.h"
+#include "../native/native.h"
+#include "../style/style.h"
+#include "../memory/memory.h"
+#include "../refs/refs.h"
+#include "../arena/arena.h"
 #include <lua.h>
+#include <algorithm>
 #include <string>
 #include <vector>
 
 namespace VDOM {
 
 
-  bool operator!=(const Length& a, const Length& b) {
-    return a.value != b.value || a.type != b.type;
+  void updateCallback(lua_State* L, int tableIdx, const char* key, int& ref) {
+    lua_getfield(L, tableIdx, key);
+    if (!lua_isfunction(L, -1)) {
+      // the handler was removed, stop calling it and let the closure go
+      lua_pop(L, 1);
+      Memory::release(L, ref);
+      return;
+    }
+
+    if (ref != -2) {
+      lua_rawgeti(L, LUA_REGISTRYINDEX, ref);
+      bool same = lua_rawequal(L, -1, -2);
+      lua_pop(L, 1);
+      if (same) {
+        lua_pop(L, 1);
+        return;
+      }
+      Memory::release(L, ref);
+    }
+    ref = Memory::retain(L);
   }
 
-  bool operator!=(const SDL_Color& a, const SDL_Color b) {
-    return a.a != b.a || a.r != b.r || a.g != b.g || a.b != b.b;
+  void updateCallbacks(lua_State* L, int tableIdx, Node* n) {
+    updateCallback(L, tableIdx, "onClick", n->onClickRef);
+    updateCallback(L, tableIdx, "onHover", n->onHoverRef);
+    updateCallback(L, tableIdx, "onPointerMove", n->onPointerMoveRef);
+    updateCallback(L, tableIdx, "onWheel", n->onWheelRef);
   }
 
-  template <typename T> 
-    void update(T& field, const T& newVal, bool& dirtyFlag) {
-      if (field != newVal) {
-        field = newVal;
-        dirtyFlag = true;
-      }
+  void patchNode(lua_State* L, Node* n, int idx) {
+    // natively built elements carry no style table, a handle that was
+    // already consumed means there is nothing new to patch from
+    uint32_t handle = Native::handleAt(L, idx);
+    if (handle) {
+      Node* incoming = Native::adopt(handle);
+      if (incoming) Native::patch(n, incoming);
+      updateCallbacks(L, idx, n);
+      return;
     }
 
-  int getIntProp(lua_State* L, const char* key, int defaultVal) {
-    // assumes stlye in already on top of lua stack
-    int val = defaultVal;
-    lua_getfield(L, -1, key);
-    if (lua_isnumber(L, -1)) {
-      val = lua_tointeger(L, -1);
+    // an element reused by index may have switched between hbox and vbox
+    lua_getfield(L, idx, "type");
+    if (lua_isstring(L, -1) && n->type != lua_tostring(L, -1)) {
+      n->type = lua_tostring(L, -1);
+      n->makeLayoutDirty();
     }
     lua_pop(L, 1);
-    return val;
-  }
 
-  float getFloatProp(lua_State* L, const char* key, float defaultVal) {
-    // assumes stlye in already on top of lua stack
-    float val = defaultVal;
-    lua_getfield(L, -1, key);
-    if (lua_isnumber(L, -1)) {
-      val = (float)lua_tonumber(L, -1);
-    }
+    // layout or paint invalidation comes from the shared style property table
+    lua_getfield(L, idx, "style");
+    Style::invalidate(n, Style::apply(L, n, lua_gettop(L), true));
     lua_pop(L, 1);
-    return val;
-  }
-
 
-  std::string getStringProp(lua_State* L, const char* key, std::string defaultVal) {
-    // assumes stlye in already on top of lua stack
-    std::string val = defaultVal;
-    lua_getfield(L, -1, key);
-    if (lua_isstring(L, -1)) {
-      val = lua_tostring(L, -1);
-    }
-    lua_pop(L, 1);
-    return val;
+    updateCallbacks(L, idx, n);
   }
 
-  void updateCallback(lua_State* L, int tableIdx, const char* key, int& ref) {
-    lua_getfield(L, tableIdx, key);
-    if (lua_isfunction(L, -1)) {
-      if (ref != -2) {
-        luaL_unref(L, LUA_REGISTRYINDEX, ref);
-      }
-      ref = luaL_ref(L, LUA_REGISTRYINDEX);
-    } else {
-      lua_pop(L, 1);
-    }
+  // one level of children being matched. The match flags and the new child
+  // list are arena scratch, handed back when the level closes
+  struct ReconcileFrame {
+    Node* current;
+    int count;
+    int next;
+    bool* reused;
+    Node** newChildren;
+    Arena::Mark start;
+  };
+
+  static std::vector<ReconcileFrame> frames;
+
+  static void openFrame(size_t depth, Node* current, int count) {
+    if (frames.size() < depth) frames.resize(depth);
+    ReconcileFrame& f = frames[depth - 1];
+    f.current = current;
+    f.count = count;
+    f.next = 0;
+    f.start = Arena::mark();
+    f.reused = Arena::array<bool>(current->children.size());
+    std::fill(f.reused, f.reused + current->children.size(), false);
+    f.newChildren = Arena::array<Node*>(count);
   }
 
-  void patchNode(lua_State* L, Node* n, int idx) {
-    lua_getfield(L, idx, "style");
-    if (!lua_istable(L, -1)) {
-      lua_pop(L, 1);
-      return;
-    }
-
-    bool layoutChanged = false;
-    bool paintChanged = false;
-
-    // comparing % w and h 
-    update(n->widthStyle, getLength(L, "w"), layoutChanged);
-    update(n->heightStyle, getLength(L, "h"), layoutChanged);
-
-    // min max height width
-    update(n->minWidth, getFloatProp(L, "minWidth", 0.0f), layoutChanged);
-    update(n->maxWidth,  getFloatProp(L, "maxWidth", 99999.0f),  layoutChanged);
-    update(n->minHeight, getFloatProp(L, "minHeight", 0.0f),     layoutChanged);
-    update(n->maxHeight, getFloatProp(L, "maxHeight", 99999.0f), layoutChanged);
-
-    // flexbox - alignItems - justifyContent
-    update(n->flexGrow, getFloatProp(L, "flexGrow", 0.0f), layoutChanged);
-    update(n->alignItems, parseAlign(getStringProp(L, "alignItems", "start")), layoutChanged);
-    update(n->justifyContent, parseJustify(getStringProp(L, "justifyContent", "start")), layoutChanged);
-
-    // we have support for both gap and spacing
-    int gapVal = getIntProp(L, "gap", getIntProp(L, "spacing", 0));
-    update(n->spacing, gapVal, layoutChanged);
-
-    // Box Model (margin / padding)
-    auto applyBoxModel = [&](const char* base, const char* t, const char* b, const char* l, const char* r, int& vBase, int& vT, int& vB, int& vL, int& vR) {
-      int val = getIntProp(L, base, 0);
-      update(vBase, val, layoutChanged);
-      update(vT, getIntProp(L, t, val), layoutChanged);
-      update(vB, getIntProp(L, b, val), layoutChanged);
-      update(vL, getIntProp(L, l, val), layoutChanged);
-      update(vR, getIntProp(L, r, val), layoutChanged);
-    };
-
-    applyBoxModel("padding", "paddingTop", "paddingBottom", "paddingLeft", "paddingRight", n->padding, n->paddingTop, n->paddingBottom, n->paddingLeft, n->paddingRight);
-    applyBoxModel("margin", "marginTop", "marginBottom", "marginLeft", "marginRight", n->margin, n->marginTop, n->marginBottom, n->marginLeft, n->marginRight);
-
-    lua_getfield(L, -1, "BGColor");
-    if (lua_isstring(L, -1)) {
-      const char* hex = lua_tostring(L, -1);
-      SDL_Color newCol = parseHexColor(hex);
-      update(n->color, newCol, paintChanged);
-
-      if (!n->hasBackground) {
-        n->hasBackground = true;
-        paintChanged = true;
-      }
-    } else if (lua_isnil(L, -1)) {
-      if (n->hasBackground) {
-        n->hasBackground = false;
-        paintChanged = true;
+  static void closeFrame(ReconcileFrame& f) {
+    Node* current = f.current;
+    for (size_t i = 0; i < current->children.size(); i++) {
+      if (!f.reused[i]) {
+        freeTree(current->children[i]);
+        current->makeLayoutDirty();
       }
     }
-    lua_pop(L, 1);
 
-    if (layoutChanged) {
-      n->makeLayoutDirty();
-    } else if (paintChanged) {
-      n->makePaintDirty();
+    // inserts, removals and reorders all move siblings around. An unchanged
+    // list is left alone so its buffer is not reallocated every pass
+    if (!std::equal(f.newChildren, f.newChildren + f.count, current->children.begin(), current->children.end())) {
+      current->makeLayoutDirty();
+      current->children.assign(f.newChildren, f.newChildren + f.count);
     }
 
-    lua_pop(L, 1);
-    updateCallback(L, idx, "onClick", n->onClickRef);
+    // deeper levels are closed already, their scratch goes with this one
+    Arena::rewind(f.start);
   }
 
-  void reconcileChildren(lua_State* L, Node* current, int childrenIdx) {
-    int luaCount = lua_rawlen(L, childrenIdx);
-
-    std::vector<bool> reused(current->children.size(), false);
-    std::vector<Node*> newChildren;
-    newChildren.reserve(luaCount);
-    
-    for (int i = 0; i < luaCount; ++i) {
-      lua_rawgeti(L, childrenIdx, i+1);
-      int childIdx = lua_gettop(L);
-
-      std::string key = "";
-      lua_getfield(L, childIdx, "key");
-      if (lua_isstring(L, -1)) key = lua_tostring(L, -1);
-      lua_pop(L, 1);
-
-      // trying to find match by key
-      Node* matchedNode = nullptr;
-      if (!key.empty()) {
-        for (size_t j = 0; j < current->children.size(); j++) {
-          if (!reused[j] && current->children[j]->key == key ) {
-            matchedNode = current->children[j];
-            reused[j] = true;
-            break;
-          }
-        }
-      }
-
-      // try to find match by index
-      if (!matchedNode) {
-        if (i < current->children.size() && !reused[i] && current->children[i]->key.empty()) {
-          matchedNode = current->children[i];
-          reused[i] = true;
+  // matches one element against the frame's old children, patched is set
+  // when an old node was reused and its children still need reconciling
+  static Node* matchChild(lua_State* L, ReconcileFrame& f, int childIdx, bool& patched) {
+    Node* current = f.current;
+    int i = f.next++;
+
+    const char* key = "";
+    lua_getfield(L, childIdx, "key");
+    if (lua_isstring(L, -1)) key = lua_tostring(L, -1);
+
+    // trying to find match by key
+    Node* matchedNode = nullptr;
+    if (*key) {
+      for (size_t j = 0; j < current->children.size(); j++) {
+        if (!f.reused[j] && current->children[j]->key == key) {
+          matchedNode = current->children[j];
+          f.reused[j] = true;
+          break;
         }
       }
+    }
 
-      if (!matchedNode) {
-        matchedNode = buildNode(L, childIdx);
-        matchedNode->parent = current;
-        matchedNode->makeLayoutDirty();
+    // try to find match by index
+    if (!matchedNode) {
+      if (i < current->children.size() && !f.reused[i] && current->children[i]->key.empty()) {
+        matchedNode = current->children[i];
+        f.reused[i] = true;
       }
+    }
 
-      patchNode(L, matchedNode, childIdx);
-
-      lua_getfield(L, childIdx, "children");
-      if (lua_istable(L, -1)) {
-        reconcileChildren(L, matchedNode, lua_gettop(L));
-      }
+    patched = matchedNode != nullptr;
+    if (!matchedNode) {
       lua_pop(L, 1);
-
-      newChildren.push_back(matchedNode);
+      // a fresh node already matches its element, nothing to patch
+      matchedNode = buildNode(L, childIdx);
+      matchedNode->parent = current;
+      matchedNode->makeLayoutDirty();
+    } else {
+      // an unkeyed node taken by index picks up the element's key
+      Refs::setKey(matchedNode, key);
       lua_pop(L, 1);
+      patchNode(L, matchedNode, childIdx);
     }
 
-    for (size_t i = 0; i < current->children.size(); i++) {
-      if (!reused[i]) {
-        freeTree(current->children[i]);
-        current->makeLayoutDirty();
-      }
-    }
-
-    current->children = newChildren;
-
+    f.newChildren[i] = matchedNode;
+    return matchedNode;
   }
 
+  // same depth first order as walking the element tree recursively, the
+  // children table of every open level is parked in a scratch table
   void reconcile(lua_State *L, Node *current, int idx) {
     if (!current) return;
 
+    luaL_checkstack(L, 8, "reconciling element tree");
+    int top = lua_gettop(L);
+    if (idx < 0 && idx > LUA_REGISTRYINDEX) idx = top + idx + 1;
+
     patchNode(L, current, idx);
+    // a hidden subtree is left as it is until it is shown again
+    if (current->displayNone) return;
 
     lua_getfield(L, idx, "children");
-    if (lua_istable(L, -1)) {
-      reconcileChildren(L, current, lua_gettop(L));
+    if (!lua_istable(L, -1)) {
+      lua_settop(L, top);
+      return;
     }
-    lua_pop(L, 1);
-  }
 
+    lua_newtable(L);
+    int levels = lua_gettop(L);
+    lua_pushvalue(L, -2);
+    lua_rawseti(L, levels, 1);
+
+    size_t depth = 1;
+    openFrame(depth, current, (int)lua_rawlen(L, -2));
+
+    while (depth > 0) {
+      ReconcileFrame& f = frames[depth - 1];
+      if (f.next == f.count) {
+        closeFrame(f);
+        depth--;
+        continue;
+      }
+
+      lua_rawgeti(L, levels, (int)depth);
+      lua_rawgeti(L, -1, f.next + 1);
+      int childIdx = lua_gettop(L);
+
+      bool patched;
+      Node* matched = matchChild(L, f, childIdx, patched);
+
+      // freshly built nodes already have their whole subtree, hidden ones
+      // keep theirs as it is
+      if (patched && !matched->displayNone) {
+        lua_getfield(L, childIdx, "children");
+        if (lua_istable(L, -1)) {
+          int count = (int)lua_rawlen(L, -1);
+          lua_rawseti(L, levels, (int)depth + 1);
+          openFrame(++depth, matched, count);
+        }
+      }
+      lua_settop(L, levels);
+    }
+
+    lua_settop(L, top);
+  }
 
 }
@@ -6,4 +6,6 @@
 namespace VDOM {
   void reconcile(lua_State *L, Node *current, int idx);
   void updateCallback(lua_State* L, int tableIdx, const char* key, int& ref);
+  // onClick, onHover, onPointerMove and onWheel
+  void updateCallbacks(lua_State* L, int tableIdx, Node* n);
 }
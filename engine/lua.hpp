@@ -4,4 +4,48 @@ extern "C" {
     #include <lua.h>
     #include <lauxlib.h>
     #include <lualib.h>
+#ifdef VULPIS_LUAJIT
+    #include <luajit.h>
+#endif
+}
+
+// LuaJIT and 5.1 lack a few of the 5.2+ names the engine uses
+#if LUA_VERSION_NUM < 502
+  #ifndef LUA_OK
+    #define LUA_OK 0
+  #endif
+  #define lua_rawlen(L, idx) lua_objlen(L, idx)
+#endif
+
+// lua_dump grew a `strip` argument in 5.3, debug info is always kept
+inline int dumpFunction(lua_State* L, lua_Writer writer, void* data) {
+#if LUA_VERSION_NUM >= 503
+  return lua_dump(L, writer, data, 0);
+#else
+  return lua_dump(L, writer, data);
+#endif
+}
+
+// lua_resume changed its signature in 5.2 and again in 5.4, results stay on co
+inline int resumeThread(lua_State* co, lua_State* from, int nargs) {
+#if LUA_VERSION_NUM >= 504
+  int results = 0;
+  return lua_resume(co, from, nargs, &results);
+#elif LUA_VERSION_NUM >= 502
+  return lua_resume(co, from, nargs);
+#else
+  (void)from;
+  return lua_resume(co, nargs);
+#endif
+}
+
+// pushes the global `vulpis` table, creating it on first use
+inline void pushVulpisTable(lua_State* L) {
+  lua_getglobal(L, "vulpis");
+  if (!lua_istable(L, -1)) {
+    lua_pop(L, 1);
+    lua_newtable(L);
+    lua_pushvalue(L, -1);
+    lua_setglobal(L, "vulpis");
+  }
 }
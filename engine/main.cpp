@@ -3,248 +3,433 @@
 #include <SDL2/SDL_events.h>
 #include <SDL2/SDL_render.h>
 #include <SDL2/SDL_video.h>
+#include <algorithm>
+#include <cstdlib>
 #include <iostream>
 #include <string>
+#include <thread>
 
 #include "components/ui/ui.h"
 #include "components/layout/layout.h"
 #include "components/state/state.h"
 #include "components/input/input.h"
 #include "components/vdom/vdom.h"
-
-int main(int argc, char* argv[]) {
-  if (SDL_Init(SDL_INIT_VIDEO) != 0) {
-    std::cout << "SDL Init Failed: " << SDL_GetError() << std::endl;
-    return 1;
-  }
+#include "components/stats/stats.h"
+#include "components/gc/gc.h"
+#include "components/runtime/runtime.h"
+#include "components/native/native.h"
+#include "components/bench/bench.h"
+#include "components/loader/loader.h"
+#include "components/layers/layers.h"
+#include "components/animation/animation.h"
+#include "components/memory/memory.h"
+#include "components/snapshot/snapshot.h"
+#include "components/render/render.h"
+#include "components/tasks/tasks.h"
+#include "components/timers/timers.h"
+#include "components/latency/latency.h"
+#include "components/replay/replay.h"
+#include "components/arena/arena.h"
+
+// longest an idle frame sleeps without input or a timer due
+static const double IDLE_WAIT_MS = 250.0;
+
+// everything the lua side of startup produces, filled on the loader thread
+struct AppStartup {
+  lua_State* L = nullptr;
+  Node* root = nullptr;
+  std::string error;
 
   int winW = 800;
   int winH = 600;
-  SDL_Window* window = nullptr;
-  SDL_Renderer* renderer = nullptr;
-
-  // initializing lua
-  lua_State* L = luaL_newstate();
-  luaL_openlibs(L);
-  registerStateBindings(L);
-
-  lua_getglobal(L, "package");
-  lua_getfield(L, -1, "path");
-  std::string paths = lua_tostring(L, -1);
-  lua_pop(L, 1);
-  
-
-paths =
-    "../?.lua;"
-    "../?/init.lua;"
-
-    "../utils/?.lua;"
-    "../utils/?/init.lua;"
-
-    "../src/?.lua;"
-    "../src/?/init.lua;"
 
-    "../lua/?.lua;"
-    "../lua/?/init.lua;"
-    + paths;
-  lua_pushstring(L, paths.c_str());
-  lua_setfield(L, -2, "path");
-  lua_pop(L, 1);
-
-  if (luaL_dofile(L, "../src/app.lua") != LUA_OK) {
-    std::cout << "Lua Error: " << lua_tostring(L, -1) << std::endl;
-    lua_close(L);
-    SDL_DestroyRenderer(renderer);
-    SDL_DestroyWindow(window);
-    SDL_Quit();
-    return 1;
+  std::string title = "Vulpis window";
+  std::string mode;
+  bool resizable = false;
+  GC::Config gcConfig;
+  size_t layerBudget = 0;
+  std::string layout;
+  std::string renderer;
+  std::string pacing;
+};
+
+// loads app.lua, builds the initial tree and reads Window(). Touches no SDL
+// state, so it runs while the main thread brings up the window and renderer
+static bool loadApp(AppStartup& app) {
+  EngineStats& stats = EngineStats::instance();
+
+  double stageStart = nowMs();
+  lua_State* L = Runtime::newState();
+  app.L = L;
+  stats.recordStage("lua_state", stageStart);
+
+  stageStart = nowMs();
+  if (Loader::doFile(L, "../src/app.lua") != LUA_OK) {
+    app.error = std::string("Lua Error: ") + lua_tostring(L, -1);
+    return false;
   }
+  stats.appLoadMs = nowMs() - stageStart;
+  stats.recordStage("app_load", stageStart);
 
+  stageStart = nowMs();
   lua_getglobal(L, "App");
   if (!lua_isfunction(L, -1)) {
-      std::cerr << "Error: Global 'App' function not found in app.lua" << std::endl;
-      return 1;
+    app.error = "Error: Global 'App' function not found in app.lua";
+    return false;
   }
 
-  
   if (lua_pcall(L, 0, 1, 0) != LUA_OK) {
-      std::cerr << "Error calling App(): " << lua_tostring(L, -1) << std::endl;
-      lua_pop(L, 1);
-      return 1;
+    app.error = std::string("Error calling App(): ") + lua_tostring(L, -1);
+    return false;
   }
 
-  
   if (!lua_istable(L, -1)) {
-      std::cerr << "Error: App() did not return a table" << std::endl;
-      lua_pop(L, 1);
-      return 1;
+    app.error = "Error: App() did not return a table";
+    return false;
   }
+  stats.recordStage("app_call", stageStart);
 
-  
-  bool hasExplicitSize = false;
   lua_getfield(L, -1, "style"); 
   if (lua_istable(L, -1)) {
     lua_getfield(L, -1, "w");
-    bool hasW = lua_isnumber(L, -1);
-    if (hasW) {
-      winW = (int)lua_tointeger(L, -1);
+    if (lua_isnumber(L, -1)) {
+      app.winW = (int)lua_tointeger(L, -1);
     }
     lua_pop(L, 1);
 
     lua_getfield(L, -1, "h");
-    bool hasH = lua_isnumber(L, -1);
-    if (hasH) {
-      winH = (int)lua_tointeger(L, -1);
+    if (lua_isnumber(L, -1)) {
+      app.winH = (int)lua_tointeger(L, -1);
     }
     lua_pop(L, 1);
-
-    hasExplicitSize = hasW && hasH;
   }
   lua_pop(L, 1); 
 
-  Node* root = buildNode(L, -1);
+  stageStart = nowMs();
+  app.root = buildNode(L, -1);
   lua_pop(L, 1);
+  Native::releasePending();
+  stats.recordStage("build_tree", stageStart);
 
-  
-  std::string windowTitle = "Vulpis window";
-  bool windowResizable = false;
-
-  
+  stageStart = nowMs();
   lua_getglobal(L, "Window");
   if (!lua_isfunction(L, -1)) {
-    lua_pop(L, 1);
-    std::cerr << "Error: Global 'Window' function not found in app.lua" << std::endl;
-    lua_close(L);
-    SDL_Quit();
-    return 1;
+    app.error = "Error: Global 'Window' function not found in app.lua";
+    return false;
   }
 
   if (lua_pcall(L, 0, 1, 0) != LUA_OK) {
-    std::cerr << "Error calling Window(): " << lua_tostring(L, -1) << std::endl;
-    lua_pop(L, 1);
-    lua_close(L);
-    SDL_Quit();
-    return 1;
+    app.error = std::string("Error calling Window(): ") + lua_tostring(L, -1);
+    return false;
   }
 
   if (!lua_istable(L, -1)) {
-    std::cerr << "Error: Window() did not return a table" << std::endl;
-    lua_pop(L, 1);
-    lua_close(L);
-    SDL_Quit();
-    return 1;
+    app.error = "Error: Window() did not return a table";
+    return false;
   }
 
-  
-  std::string mode;
   lua_getfield(L, -1, "mode");
-  if (lua_isstring(L, -1)) mode = lua_tostring(L, -1);
+  if (lua_isstring(L, -1)) app.mode = lua_tostring(L, -1);
   lua_pop(L, 1);
 
   lua_getfield(L, -1, "title");
-  if (lua_isstring(L, -1)) windowTitle = lua_tostring(L, -1);
+  if (lua_isstring(L, -1)) app.title = lua_tostring(L, -1);
   lua_pop(L, 1);
 
   lua_getfield(L, -1, "resizable");
-  if (lua_isboolean(L, -1)) windowResizable = lua_toboolean(L, -1);
+  if (lua_isboolean(L, -1)) app.resizable = lua_toboolean(L, -1);
   lua_pop(L, 1);
 
-  Uint32 windowFlags = SDL_WINDOW_SHOWN;
-
-  if (mode == "full") {
-    windowFlags |= SDL_WINDOW_MAXIMIZED;
-    windowFlags |= SDL_WINDOW_RESIZABLE;
-  } else if (mode == "whole screen") {
-    windowFlags = SDL_WINDOW_FULLSCREEN_DESKTOP;
-  } else {
-    
+  if (app.mode != "full" && app.mode != "whole screen") {
     lua_getfield(L, -1, "w");
     bool hasW2 = lua_isnumber(L, -1);
-    if (hasW2) winW = (int)lua_tointeger(L, -1);
+    if (hasW2) app.winW = (int)lua_tointeger(L, -1);
     lua_pop(L, 1);
 
     lua_getfield(L, -1, "h");
     bool hasH2 = lua_isnumber(L, -1);
-    if (hasH2) winH = (int)lua_tointeger(L, -1);
+    if (hasH2) app.winH = (int)lua_tointeger(L, -1);
     lua_pop(L, 1);
 
     if (!(hasW2 && hasH2)) {
-      std::cerr << "Error: Window() must include numeric 'w' and 'h' when mode is not 'full' or 'whole screen'" << std::endl;
-      lua_pop(L, 1); 
-      lua_close(L);
-      SDL_Quit();
-      return 1;
+      app.error = "Error: Window() must include numeric 'w' and 'h' when mode is not 'full' or 'whole screen'";
+      return false;
     }
-
-    if (windowResizable) windowFlags |= SDL_WINDOW_RESIZABLE;
   }
 
+  app.gcConfig = GC::readConfig(L, -1);
+  app.layerBudget = Layers::readBudget(L, -1);
+  app.layout = Layout::readSolver(L, -1);
+  app.renderer = Render::readBackend(L, -1);
+  app.pacing = Latency::readPacing(L, -1);
+
   lua_pop(L, 1); 
+  stats.recordStage("window_config", stageStart);
+  return true;
+}
+
+static Snapshot::Window windowConfig(const AppStartup& app) {
+  return {app.winW, app.winH, app.title, app.mode, app.resizable};
+}
+
+// the window is created hidden before Window() is known, this brings it in
+// line. A headless run keeps it hidden
+static void applyWindowConfig(SDL_Window* window, const Snapshot::Window& config, bool show) {
+  SDL_SetWindowTitle(window, config.title.c_str());
+
+  if (config.mode == "whole screen") {
+    SDL_SetWindowFullscreen(window, SDL_WINDOW_FULLSCREEN_DESKTOP);
+  } else {
+    // the snapshot may have left the window fullscreen or maximized
+    SDL_SetWindowFullscreen(window, 0);
+    SDL_RestoreWindow(window);
+    SDL_SetWindowResizable(window, (config.mode == "full" || config.resizable) ? SDL_TRUE : SDL_FALSE);
+    SDL_SetWindowSize(window, config.w, config.h);
+    SDL_SetWindowPosition(window, SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED);
+    if (config.mode == "full") {
+      SDL_MaximizeWindow(window);
+    }
+  }
+
+  if (show) SDL_ShowWindow(window);
+}
+
+int main(int argc, char* argv[]) {
+  EngineStats& stats = EngineStats::instance();
+  stats.startMs = nowMs();
+
+  if (argc > 1 && std::string(argv[1]) == "--bench") {
+    return Bench::run(argc, argv);
+  }
+
+  // --layout=yoga|default, --renderer=sdl|software and --pacing=vsync|adaptive
+  // win over Window(), --screenshot=<file.bmp> saves the first frame and quits.
+  // --record=<file> and --replay=<file> capture and play back input, see Replay
+  std::string layoutFlag;
+  std::string rendererFlag;
+  std::string pacingFlag;
+  std::string screenshotPath;
+  Replay::Options replayOptions;
+  bool headless = false;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (Replay::parseFlag(arg, replayOptions)) continue;
+    if (arg == "--headless") headless = true;
+    if (arg.rfind("--layout=", 0) == 0) layoutFlag = arg.substr(9);
+    if (arg.rfind("--renderer=", 0) == 0) rendererFlag = arg.substr(11);
+    if (arg.rfind("--pacing=", 0) == 0) pacingFlag = arg.substr(9);
+    if (arg.rfind("--screenshot=", 0) == 0) screenshotPath = arg.substr(13);
+  }
+
+  AppStartup app;
+  bool appLoaded = false;
+  std::thread loader([&app, &appLoaded]() {
+    appLoaded = loadApp(app);
+  });
 
+  // no display needed, frames are still rendered for their timings
+  if (headless) {
+    SDL_SetHint(SDL_HINT_VIDEODRIVER, "dummy");
+  }
+
+  double stageStart = nowMs();
+  if (SDL_Init(SDL_INIT_VIDEO) != 0) {
+    std::cout << "SDL Init Failed: " << SDL_GetError() << std::endl;
+    loader.join();
+    Tasks::shutdown();
+    freeTree(app.root);
+    lua_close(app.L);
+    return 1;
+  }
+  stats.recordStage("sdl_init", stageStart);
 
-  window = SDL_CreateWindow(
-    windowTitle.c_str(),
+  stageStart = nowMs();
+  // app is still being filled by the loader thread, start from its defaults
+  const AppStartup defaults;
+  SDL_Window* window = SDL_CreateWindow(
+    "Vulpis window",
     SDL_WINDOWPOS_CENTERED,
     SDL_WINDOWPOS_CENTERED,
-    winW,
-    winH,
-    windowFlags
+    defaults.winW,
+    defaults.winH,
+    SDL_WINDOW_HIDDEN
   );
 
   if (!window) {
     std::cout << "Window Creation Failed: " << SDL_GetError() << std::endl;
-    lua_close(L);
+    loader.join();
+    Tasks::shutdown();
+    freeTree(app.root);
+    lua_close(app.L);
     SDL_Quit();
     return 1;
   }
+  stats.recordStage("window", stageStart);
 
-  
-  if (hasExplicitSize) {
-    SDL_SetWindowSize(window, winW, winH);
-  }
-
-  
-  SDL_GetWindowSize(window, &winW, &winH);
-
-
-  renderer = SDL_CreateRenderer(
+  stageStart = nowMs();
+  // uncapped replays measure frame cost, not the display rate
+  SDL_Renderer* renderer = SDL_CreateRenderer(
     window,
     -1,
-    SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC
+    SDL_RENDERER_ACCELERATED | (replayOptions.uncapped ? 0 : SDL_RENDERER_PRESENTVSYNC)
   );
 
+  // machines without a gpu still get a window, the software backend is meant for them
+  if (!renderer) {
+    renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_SOFTWARE);
+  }
+
   if (!renderer) {
     std::cout << "Renderer Creation Failed: " << SDL_GetError() << std::endl;
+    loader.join();
+    Tasks::shutdown();
+    freeTree(app.root);
+    lua_close(app.L);
     SDL_DestroyWindow(window);
-    lua_close(L);
     SDL_Quit();
     return 1;
   }
 
   SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+  stats.recordStage("renderer", stageStart);
+
+  // last launch's first frame goes up while app.lua is still loading
+  bool warm = !headless && Snapshot::open();
+  if (warm) {
+    stageStart = nowMs();
+    applyWindowConfig(window, Snapshot::window(), true);
+    Snapshot::paint(renderer);
+    SDL_RenderPresent(renderer);
+    stats.warmFrameMs = nowMs() - stats.startMs;
+    stats.recordStage("snapshot_frame", stageStart);
+  }
+
+  stageStart = nowMs();
+  loader.join();
+  stats.recordStage("wait_app", stageStart);
+
+  lua_State* L = app.L;
+  Node* root = app.root;
+
+  if (!appLoaded) {
+    std::cerr << app.error << std::endl;
+    Tasks::shutdown();
+    freeTree(root);
+    lua_close(L);
+    SDL_DestroyRenderer(renderer);
+    SDL_DestroyWindow(window);
+    SDL_Quit();
+    return 1;
+  }
+
+  // moving or resizing the window again would flicker when nothing changed
+  if (!warm || !(windowConfig(app) == Snapshot::window())) {
+    applyWindowConfig(window, windowConfig(app), !headless);
+  }
+
+  int winW = app.winW;
+  int winH = app.winH;
+  SDL_GetWindowSize(window, &winW, &winH);
 
-  Layout::LayoutSolver* solver = Layout::createYogaSolver();
+  if (!Replay::start(replayOptions, winW, winH)) {
+    Tasks::shutdown();
+    freeTree(root);
+    lua_close(L);
+    SDL_DestroyRenderer(renderer);
+    SDL_DestroyWindow(window);
+    SDL_Quit();
+    return 1;
+  }
+
+  // a replay lays out at the size it was recorded at
+  if (Replay::replaying()) {
+    Replay::windowSize(winW, winH);
+    SDL_SetWindowSize(window, winW, winH);
+  }
+
+  // gc steps are fitted into the time left before the next vsync
+  double frameIntervalMs = 1000.0 / 60.0;
+  SDL_DisplayMode displayMode;
+  if (SDL_GetWindowDisplayMode(window, &displayMode) == 0 && displayMode.refresh_rate > 0) {
+    frameIntervalMs = 1000.0 / displayMode.refresh_rate;
+  }
+  GC::init(L, app.gcConfig);
+  Layers::configure(app.layerBudget);
+
+  stageStart = nowMs();
+  std::string layoutName = layoutFlag.empty() ? app.layout : layoutFlag;
+  Layout::LayoutSolver* solver = Layout::createSolver(layoutName);
+  if (!solver) {
+    std::cerr << "Layout Error: unknown solver '" << layoutName << "', using yoga" << std::endl;
+    solver = Layout::createYogaSolver();
+  }
+
+  std::string backendName = rendererFlag.empty() ? app.renderer : rendererFlag;
+  Render::RenderBackend* backend = Render::createBackend(backendName, renderer);
+  if (!backend) {
+    std::cerr << "Render Error: unknown renderer '" << backendName << "', using sdl" << std::endl;
+    backend = new Render::SdlBackend(renderer);
+  }
+
+  std::string pacingName = pacingFlag.empty() ? app.pacing : pacingFlag;
+  if (!Latency::configure(pacingName, frameIntervalMs)) {
+    std::cerr << "Pacing Error: unknown pacing '" << pacingName << "', using vsync" << std::endl;
+    Latency::configure("vsync", frameIntervalMs);
+  }
   solver->solve(root, {winW, winH});
-  root->isLayoutDirty = false;
-  root->isPaintDirty = false;
+  root->isPaintDirty = true;
+  stats.recordStage("first_layout", stageStart);
+  Memory::track(root);
 
   bool running = true;
-  SDL_Event event;
+  bool resizePending = false;
+  double lastResizeMs = 0;
 
   while (running) {
-    while (SDL_PollEvent(&event)) {
-      if (event.type == SDL_QUIT) {
-        running = false;
-      }
-
-      Input::handleEvent(L, event, root);
+    // adaptive pacing holds frame work back until just before vsync so the
+    // input it reads is as fresh as possible, the gc gets the wait. A replay
+    // keeps the recorded pace instead
+    double wake = Replay::replaying() ? 0 : Latency::wakeTime(nowMs());
+    if (wake > nowMs()) {
+      GC::step(L, wake);
+      double left = wake - nowMs();
+      if (left >= 1) SDL_Delay((Uint32)left);
+    }
 
-      if (event.type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_RESIZED) {
-        winW = event.window.data1;
-        winH = event.window.data2;
-        root->makeLayoutDirty();
-      }
+    double frameStart = nowMs();
+    if (!Replay::beginFrame(frameStart)) break;
+    // scratch of the last frame is dead
+    Arena::reset();
+    // timers, transitions and the resize throttle follow the replayed clock
+    double clock = clockMs();
+    Replay::FrameTiming timing;
+
+    Input::Frame input = Input::poll();
+    if (input.quit) {
+      running = false;
     }
+    if (input.resized) {
+      winW = input.w;
+      winH = input.h;
+      resizePending = true;
+    }
+    // a drag resizes many times a frame, the viewport is re-solved at most at the display rate
+    if (resizePending && clock - lastResizeMs >= frameIntervalMs) {
+      Layout::invalidateViewport(root);
+      lastResizeMs = clock;
+      resizePending = false;
+    }
+    if (input.exposed) {
+      root->makePaintDirty();
+    }
+
+    // handlers only queue state changes, the reconcile below picks them up
+    Input::dispatch(L, root);
+    Latency::mark(Latency::Stage::Dispatch, nowMs());
+
+    // finished background tasks land in the same reconcile
+    Tasks::deliver(L);
+    Timers::tick(L, clock);
 
     if (StateManager::instance().isDirty()) {
       lua_getglobal(L, "App");
@@ -261,29 +446,99 @@ paths =
 
           VDOM::reconcile(L, root, -1);
           lua_pop(L, 1);
+          Native::releasePending();
+          Memory::flush(L);
+          Memory::checkRefs();
         }
       }
 
       StateManager::instance().clearDirty();
     }
+    Latency::mark(Latency::Stage::Reconcile, nowMs());
+
+    Memory::tick(L, frameStart);
 
+    // transitions are interpolated natively, App() is not re-run for them
+    Animation::tick(clock);
+
+    // paint only changes skip the solver entirely
     if (root->isLayoutDirty) {
       solver->solve(root, {winW, winH});
-      root->isLayoutDirty = false;
+      stats.layoutSolves++;
+      root->isPaintDirty = true;
+      timing.solved = true;
+    }
+    double updateEnd = nowMs();
+    Latency::mark(Latency::Stage::Layout, updateEnd);
+    timing.updateMs = updateEnd - frameStart;
+
+    if (!root->isPaintDirty) {
+      // input that changed nothing on screen has no latency to report
+      Latency::discard();
+      Replay::endFrame(timing);
+
+      // nothing to redraw, the whole frame is slack for the gc
+      GC::step(L, frameStart + frameIntervalMs - 1.0);
+
+      // sleep until input or the next timer instead of spinning every vsync,
+      // capped so periodic engine work still gets its tick
+      double now = nowMs();
+      double waitMs = Timers::nextDeadline(now);
+      if (waitMs < 0 || waitMs > IDLE_WAIT_MS) waitMs = IDLE_WAIT_MS;
+      if (resizePending) waitMs = std::min(waitMs, lastResizeMs + frameIntervalMs - now);
+      if (waitMs >= 1 && !Replay::replaying()) SDL_WaitEventTimeout(nullptr, (int)waitMs);
+      continue;
     }
 
-    SDL_SetRenderDrawColor(renderer, 30, 30, 30, 255);
-    SDL_RenderClear(renderer);
+    backend->begin(winW, winH, {30, 30, 30, 255});
 
-    renderNode(renderer, root);
-    SDL_RenderPresent(renderer);
+    renderNode(*backend, root);
+
+    stats.frameTimeMs = nowMs() - frameStart;
+    stats.frames++;
+
+    if (!screenshotPath.empty()) {
+      Render::saveScreenshot(*backend, screenshotPath);
+      running = false;
+    }
+
+    Latency::frameWork(frameStart, nowMs());
+    GC::step(L, Latency::frameDeadline(frameStart));
+    double presentStart = nowMs();
+    backend->present();
+    double presentEnd = nowMs();
+    Latency::presented(presentEnd);
+    Latency::framePresented(presentEnd);
+
+    timing.renderMs = presentStart - updateEnd;
+    timing.presentMs = presentEnd - presentStart;
+    timing.drawn = true;
+    Replay::endFrame(timing);
+
+    if (stats.frames == 1) {
+      stats.recordStage("first_frame", frameStart);
+      stats.firstFrameMs = nowMs() - stats.startMs;
+      Snapshot::save(root, windowConfig(app), Loader::sources());
+      Snapshot::close();
+      if (const char* trace = std::getenv("VULPIS_TRACE_STARTUP")) {
+        reportStartup(trace);
+      }
+    }
+  }
+
+  Replay::finish();
+
+  if (const char* trace = std::getenv("VULPIS_TRACE_LATENCY")) {
+    Latency::report(trace);
   }
 
   freeTree(root);
+  delete solver;
+  delete backend;
   SDL_DestroyRenderer(renderer);
   SDL_DestroyWindow(window);
+  Tasks::shutdown();
   SDL_Quit();
-  lua_close(L);;
+  lua_close(L);
   return 0;
 }
-
@@ -0,0 +1,39 @@
+-- trees used by `vulpis --bench`, the same shape is built through plain
+-- element tables and, on LuaJIT, through the native ffi path
+
+local elements = require("core.elements")
+local native = require("core.native")
+
+local bench = {}
+
+bench.hasNative = native.available
+
+local function rows(lib, count, tick)
+	local children = {}
+	for i = 1, count do
+		local shade = (i + tick) % 2 == 0 and "#202020" or "#303030"
+		children[i] = lib.HBox({
+			key = "row" .. i,
+			style = { h = 20, padding = 2, gap = 4, alignItems = "center", BGColor = shade },
+			children = {
+				lib.Box({ style = { w = 40, h = 16, BGColor = "#ff8800" } }),
+				lib.Box({ style = { flexGrow = 1, h = 16 } }),
+			},
+		})
+	end
+
+	return lib.VBox({
+		style = { w = "100%", h = "100%", gap = 1 },
+		children = children,
+	})
+end
+
+function bench.tableTree(count, tick)
+	return rows(elements, count, tick)
+end
+
+function bench.nativeTree(count, tick)
+	return rows(native, count, tick)
+end
+
+return bench
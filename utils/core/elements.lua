@@ -38,6 +38,9 @@ function elements.Box(props)
         style = props.style or {},
         children = props.children or {},
         onClick = props.onClick,
+        onHover = props.onHover,
+        onPointerMove = props.onPointerMove,
+        onWheel = props.onWheel,
         key = props.key,
     }
     return node
@@ -0,0 +1,103 @@
+-- FFI fast path for building nodes, only available when running on LuaJIT.
+-- Elements built here skip the per-field table reads in buildNode and patchNode;
+-- callbacks are only read from the returned table, not from native children.
+
+local native = {}
+
+local ok, ffi = pcall(require, "ffi")
+native.available = false
+
+if ok then
+	ffi.cdef([[
+		uint32_t vulpis_node_new(const char* type, const char* key);
+		void vulpis_node_set_size(uint32_t h, float w, int wPercent, float hgt, int hPercent);
+		void vulpis_node_set_limits(uint32_t h, float minW, float maxW, float minH, float maxH);
+		void vulpis_node_set_padding(uint32_t h, int top, int right, int bottom, int left);
+		void vulpis_node_set_margin(uint32_t h, int top, int right, int bottom, int left);
+		void vulpis_node_set_gap(uint32_t h, int gap);
+		void vulpis_node_set_flex(uint32_t h, float grow, const char* alignItems, const char* justifyContent);
+		void vulpis_node_set_color(uint32_t h, uint8_t r, uint8_t g, uint8_t b, uint8_t a);
+		void vulpis_node_set_color_hex(uint32_t h, const char* hex);
+		void vulpis_node_set_display(uint32_t h, int none);
+		void vulpis_node_append(uint32_t parent, uint32_t child);
+		void vulpis_node_free(uint32_t h);
+	]])
+	native.available = pcall(function()
+		return ffi.C.vulpis_node_new
+	end)
+end
+
+if not native.available then
+	return native
+end
+
+local C = ffi.C
+
+local function length(v)
+	if type(v) == "number" then
+		return v, 0
+	elseif type(v) == "string" and v:sub(-1) == "%" then
+		return tonumber(v:sub(1, -2)) or 0, 1
+	end
+	return 0, 0
+end
+
+local function box(style, fallback, top, right, bottom, left)
+	local base = style[fallback] or 0
+	return style[top] or base, style[right] or base, style[bottom] or base, style[left] or base
+end
+
+local function build(typeName, props)
+	local style = props.style or {}
+	local h = C.vulpis_node_new(typeName, props.key)
+
+	local w, wp = length(style.w)
+	local hh, hp = length(style.h)
+	C.vulpis_node_set_size(h, w, wp, hh, hp)
+	C.vulpis_node_set_limits(h, style.minWidth or 0, style.maxWidth or 99999, style.minHeight or 0, style.maxHeight or 99999)
+	C.vulpis_node_set_padding(h, box(style, "padding", "paddingTop", "paddingRight", "paddingBottom", "paddingLeft"))
+	C.vulpis_node_set_margin(h, box(style, "margin", "marginTop", "marginRight", "marginBottom", "marginLeft"))
+	C.vulpis_node_set_gap(h, style.gap or style.spacing or 0)
+	C.vulpis_node_set_flex(h, style.flexGrow or 0, style.alignItems, style.justifyContent)
+
+	local bg = style.BGColor
+	if type(bg) == "string" then
+		C.vulpis_node_set_color_hex(h, bg)
+	elseif type(bg) == "table" then
+		C.vulpis_node_set_color(h, bg[1] or 255, bg[2] or 255, bg[3] or 255, bg[4] or 255)
+	end
+
+	if style.display == "none" then
+		C.vulpis_node_set_display(h, 1)
+	end
+
+	for _, child in ipairs(props.children or {}) do
+		assert(child.native, "native elements can only have native children")
+		C.vulpis_node_append(h, child.native)
+	end
+
+	return {
+		type = typeName,
+		key = props.key,
+		onClick = props.onClick,
+		onHover = props.onHover,
+		onPointerMove = props.onPointerMove,
+		onWheel = props.onWheel,
+		native = h,
+	}
+end
+
+function native.Box(props)
+	props = props or {}
+	return build(props.type or "hbox", props)
+end
+
+function native.VBox(props)
+	return build("vbox", props or {})
+end
+
+function native.HBox(props)
+	return build("hbox", props or {})
+end
+
+return native